@@ -0,0 +1,96 @@
+from __future__ import print_function
+import argparse
+import csv
+import math
+import os
+import subprocess
+import sys
+
+# Equal-time comparison of several scene variants (e.g. the same scene
+# rendered with different integrators or samplers). Every scene is rendered
+# progressively using 'nori --convergence', which records the error with
+# respect to a high sample count reference image after each pass. This
+# script then reports the time that each variant needs to reach a given
+# error and optionally plots the error over time.
+#
+# Example:
+#   python convergence.py --reference cbox_ref.exr --passes 32 --plot cbox.png \
+#       scenes/pa5/cbox/cbox_ems.xml scenes/pa5/cbox/cbox_mis.xml
+
+parser = argparse.ArgumentParser(description="Measure the convergence of scene variants over time")
+parser.add_argument("scenes", nargs="+", help="scene files to be compared")
+parser.add_argument("--reference", required=True, help="reference image (EXR)")
+parser.add_argument("--passes", type=int, default=16, help="number of rendering passes")
+parser.add_argument("--metric", choices=["mse", "relmse"], default="relmse")
+parser.add_argument("--target", type=float, default=None,
+                    help="error for the time-to-error comparison (default: the "
+                         "largest final error of all variants)")
+parser.add_argument("--plot", default=None, help="write a plot of the error over time")
+parser.add_argument("--nori", default="./build/nori", help="path of the nori executable")
+args = parser.parse_args()
+
+
+def render(scene):
+    output = os.path.splitext(scene)[0]
+    ret = subprocess.call([args.nori, "--no-gui", "--passes", "0", str(args.passes),
+                           "--convergence", args.reference, "--output", output, scene])
+    if ret != 0:
+        return None
+    with open(output + "_convergence.csv") as f:
+        return [dict((k, float(v)) for k, v in row.items()) for row in csv.DictReader(f)]
+
+
+def time_to_error(rows, target):
+    """Time at which the error first falls below 'target' (log-log interpolation)"""
+    previous = None
+    for row in rows:
+        if row[args.metric] <= target:
+            if previous is None or previous[args.metric] <= 0 or row[args.metric] <= 0:
+                return row["seconds"]
+            t = (math.log(previous[args.metric]) - math.log(target)) / \
+                (math.log(previous[args.metric]) - math.log(row[args.metric]))
+            return math.exp((1 - t) * math.log(previous["seconds"]) + t * math.log(row["seconds"]))
+        previous = row
+    return None
+
+
+results = []
+for scene in args.scenes:
+    rows = render(scene)
+    if not rows:
+        print("\033[91m" + "Failed to render " + scene + "\033[0m")
+        sys.exit(1)
+    results.append((scene, rows))
+
+target = args.target
+if target is None:
+    target = max(rows[-1][args.metric] for _, rows in results)
+
+print("")
+print("%-40s %10s %14s %14s %16s" % ("Scene", "seconds", args.metric, "efficiency", "time to %.3g" % target))
+for scene, rows in results:
+    final = rows[-1]
+    # Monte Carlo efficiency: inverse of the product of error and time
+    efficiency = 1.0 / (final[args.metric] * final["seconds"]) if final[args.metric] > 0 else float("inf")
+    reached = time_to_error(rows, target)
+    print("%-40s %10.3f %14.6g %14.6g %16s" % (scene, final["seconds"], final[args.metric], efficiency,
+          "%.3f s" % reached if reached is not None else "not reached"))
+
+if args.plot:
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib is not available, skipping the plot")
+        sys.exit(0)
+
+    for scene, rows in results:
+        plt.loglog([r["seconds"] for r in rows], [r[args.metric] for r in rows], "o-", label=scene)
+    plt.axhline(target, color="gray", linestyle="--")
+    plt.xlabel("Rendering time (s)")
+    plt.ylabel(args.metric)
+    plt.legend()
+    plt.grid(True, which="both", alpha=0.3)
+    plt.savefig(args.plot, dpi=150)
+    print("Wrote " + args.plot)
@@ -20,9 +20,13 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define __NORI_BVH_H
 
 #include <nori/mesh.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
+/// Number of closest-hit rays traced so far (used to derive path lengths)
+NORI_STAT_EXTERN_COUNTER(statClosestHitRays);
+
 /**
 * \brief Bounding Volume Hierarchy for fast ray intersection queries
 *
@@ -80,6 +84,28 @@ public:
 	bool rayIntersect(const Ray3f &ray, Intersection &its,
 		bool shadowRay = false) const;
 
+	/**
+	* \brief Find the closest intersection along a ray, but only
+	* return a compact \ref HitRecord
+	*
+	* The full intersection record can be computed later (if needed)
+	* using \ref HitRecord::computeIntersection().
+	*
+	* \return \c true If an intersection was found
+	*/
+	bool rayIntersect(const Ray3f &ray, HitRecord &hit) const;
+
+	/// Check whether there is any intersection along a ray (e.g. for shadow rays)
+	bool rayIntersect(const Ray3f &ray) const;
+
+	/**
+	* \brief Return the number of rays that the calling thread has traced so far
+	*
+	* The count is kept in a thread-local variable, hence tracing a ray
+	* only costs an ordinary increment (e.g. for progress reporting).
+	*/
+	static uint64_t getThreadRayCount();
+
 	/// Return the total number of meshes registered with the BVH
 	uint32_t getMeshCount() const { return (uint32_t)m_meshes.size(); }
 
@@ -92,6 +118,9 @@ public:
 	/// Return one of the registered meshes (const version)
 	const Mesh *getMesh(uint32_t idx) const { return m_meshes[idx]; }
 
+	/// Return the time (in milliseconds) that it took to build the BVH
+	double getBuildTime() const { return m_buildTime; }
+
 	//// Return an axis-aligned bounding box containing the entire tree
 	const BoundingBox3f &getBoundingBox() const {
 		return m_bbox;
@@ -120,6 +149,12 @@ protected:
 		return m_meshes[meshIdx]->getCentroid(index);
 	}
 
+	/**
+	* \brief Traverse the BVH to find the closest intersection (or, if
+	* \c ShadowRay is set, any intersection) along a ray
+	*/
+	template <bool ShadowRay> bool traverse(const Ray3f &ray, HitRecord &hit) const;
+
 	/// Compute internal tree statistics
 	std::pair<float, uint32_t> statistics(uint32_t index = 0) const;
 
@@ -168,6 +203,7 @@ private:
 	std::vector<BVHNode> m_nodes;       ///< BVH nodes
 	std::vector<uint32_t> m_indices;    ///< Index references by BVH nodes
 	BoundingBox3f m_bbox;               ///< Bounding box of the entire BVH
+	double m_buildTime = 0;             ///< Duration of the last build in milliseconds
 };
 
 NORI_NAMESPACE_END
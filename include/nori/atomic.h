@@ -0,0 +1,77 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* =======================================================================
+     This file contains a few lock-free helper functions for accessing
+     floating point values that are shared between several threads.
+ * ======================================================================= */
+
+#pragma once
+
+#include <nori/common.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/// Load a floating point value that may concurrently be written by another thread
+inline float atomicLoad(const float *src) {
+#if defined(_MSC_VER)
+    return *((const volatile float *) src);
+#else
+    float result;
+    __atomic_load(src, &result, __ATOMIC_RELAXED);
+    return result;
+#endif
+}
+
+/// Store a floating point value that may concurrently be read by another thread
+inline void atomicStore(float *dst, float value) {
+#if defined(_MSC_VER)
+    *((volatile float *) dst) = value;
+#else
+    __atomic_store(dst, &value, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * \brief Atomically add \c value to the floating point number at \c dst
+ *
+ * This is implemented using a compare-and-swap loop, hence it never
+ * blocks the calling thread.
+ */
+inline void atomicAdd(float *dst, float value) {
+#if defined(_MSC_VER)
+    union { long i; float f; } oldValue, newValue;
+    do {
+        oldValue.f = *((volatile float *) dst);
+        newValue.f = oldValue.f + value;
+    } while (_InterlockedCompareExchange((volatile long *) dst,
+                newValue.i, oldValue.i) != oldValue.i);
+#else
+    float oldValue = atomicLoad(dst), newValue;
+    do {
+        newValue = oldValue + value;
+    } while (!__atomic_compare_exchange(dst, &oldValue, &newValue, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#endif
+}
+
+NORI_NAMESPACE_END
@@ -47,6 +47,17 @@ public:
     /// Save the bitmap as an EXR file with the specified filename
     void saveEXR(const std::string &filename);
 
+    /**
+     * \brief Save the bitmap together with a set of named layers (e.g.
+     * arbitrary output variables) as a multi-channel EXR file
+     *
+     * The bitmap itself provides the \c R, \c G and \c B channels, and
+     * each layer adds the channels \c name.R, \c name.G and \c name.B.
+     * All layers must have the same size as the bitmap.
+     */
+    void saveEXR(const std::string &filename,
+                 const std::vector<std::pair<std::string, const Bitmap *>> &layers);
+
     /// Save the bitmap as a PNG file (with sRGB tonemapping) with the specified filename
     void savePNG(const std::string &filename);
 };
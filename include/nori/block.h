@@ -24,7 +24,8 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
-#include <tbb/mutex.h>
+#include <nori/dpdf.h>
+#include <atomic>
 
 #define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
 
@@ -46,6 +47,8 @@ NORI_NAMESPACE_BEGIN
  */
 class ImageBlock : public Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
+    typedef Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Base;
+
     /**
      * Create a new image block of the specified maximum size
      * \param size
@@ -91,19 +94,93 @@ public:
     /// Record a sample with the given position and radiance value
     void put(const Point2f &pos, const Color3f &value);
 
+    /**
+     * \brief Record a batch of samples with the given positions
+     * and radiance values
+     *
+     * This is equivalent to calling \ref put() for each sample in
+     * turn, but amortizes the per-call overheads. The filter weights
+     * of each sample are computed for all affected rows and columns at
+     * once, and rows of pixels are updated using packet operations.
+     */
+    void put(const Point2f *pos, const Color3f *values, size_t count);
+
+    /// Does this block importance sample its reconstruction filter?
+    bool isFilterImportanceSampled() const { return m_filterPDF.isNormalized(); }
+
+    /**
+     * \brief Warp a uniformly distributed sample on <tt>[0, 1]^2</tt> to
+     * an offset from the pixel center that is distributed according to
+     * the absolute value of the reconstruction filter
+     *
+     * Only valid if \ref isFilterImportanceSampled() returns \c true.
+     *
+     * \param weight
+     *     Used to return the sign of the filter at the sampled offset
+     *     (only the values are multiplied by it, see \ref put())
+     * \return
+     *     The offset from the pixel center in fractional pixels
+     */
+    Vector2f sampleFilter(const Point2f &sample, float &weight) const;
+
+    /**
+     * \brief Record a batch of weighted samples that only contribute
+     * to the specified pixel
+     *
+     * This is used when the reconstruction filter is importance sampled
+     * (see \ref sampleFilter()). The pixel position is specified in
+     * image coordinates. Each sample adds the same amount to the filter
+     * weight of the pixel (the ratio of the signed and the absolute
+     * filter integral), regardless of the sign of its weight.
+     */
+    void put(const Point2i &pixel, const Color3f *values, const float *weights, size_t count);
+
+    /**
+     * \brief Save the unnormalized contents of the block (excluding
+     * the border region) as an OpenEXR file
+     *
+     * In addition to the color channels \c R, \c G and \c B, the file
+     * contains the accumulated filter weights in a channel named \c W.
+     * Several such files that were rendered separately (e.g. different
+     * crop windows or passes) can be merged by adding them up, which is
+     * what \ref loadEXR() and the \c --merge mode of Nori do.
+     */
+    void saveEXR(const std::string &filename) const;
+
+    /**
+     * \brief Load an unnormalized OpenEXR file written by \ref saveEXR()
+     *
+     * The block is resized to match the file, and its offset is reset.
+     * This is only supported for blocks without a border region.
+     */
+    void loadEXR(const std::string &filename);
+
     /**
      * \brief Merge another image block into this one
      *
-     * During the merge operation, this function locks 
-     * the destination block using a mutex.
+     * This function is lock-free and may be called concurrently for
+     * blocks produced by a \ref BlockGenerator. Within a single pass,
+     * such blocks never overlap, hence the merge only needs to synchronize
+     * on the pixels that are shared with the border regions of neighboring
+     * blocks. These are updated using atomic additions, while all remaining
+     * pixels are exclusively owned by \c b and simply added.
+     *
+     * \param overlapping
+     *    Set this to \c true if blocks covering the same pixels may be
+     *    merged concurrently (e.g. the same tile in several passes). All
+     *    pixels are then updated using atomic additions.
      */
-    void put(ImageBlock &b);
+    void put(ImageBlock &b, bool overlapping = false);
 
-    /// Lock the image block (using an internal mutex)
-    inline void lock() const { m_mutex.lock(); }
-    
-    /// Unlock the image block
-    inline void unlock() const { m_mutex.unlock(); }
+    /**
+     * \brief Copy the contents of the block (including the border region)
+     * into \c target
+     *
+     * In contrast to accessing the block's coefficients directly, this
+     * function can safely be called while other threads are merging
+     * blocks via \ref put(). It never blocks any of these threads.
+     */
+    void snapshot(Base &target) const;
 
     /// Return a human-readable string summary
     std::string toString() const;
@@ -115,52 +192,114 @@ protected:
     float m_filterRadius = 0;
     float *m_weightsX = nullptr;
     float *m_weightsY = nullptr;
+    float *m_splatRow = nullptr;
     float m_lookupFactor = 0;
-    mutable tbb::mutex m_mutex;
+    float m_filterSampleWeight = 1.0f;
+    DiscretePDF m_filterPDF;
 };
 
 /**
- * \brief Spiraling block generator
+ * \brief Lock-free block generator
  *
  * This class can be used to chop up an image into many small
  * rectangular blocks suitable for parallel rendering. The blocks
- * are ordered in spiraling pattern so that the center is
- * rendered first.
+ * are traversed along a Hilbert curve, which keeps consecutively
+ * rendered blocks close to each other in the image (and thus
+ * typically also in the scene).
+ *
+ * Rendering threads pull blocks using an atomic counter. To reduce
+ * the time that threads spend idling at the end of a frame while a
+ * few expensive blocks are still being rendered, the blocks at the
+ * end of the sequence are split into four smaller sub-blocks.
  */
 class BlockGenerator {
 public:
     /**
      * \brief Create a block generator with
      * \param size
-     *      Size of the image that should be split into blocks
+     *      Size of the image (or crop window) that should be split into blocks
      * \param blockSize
      *      Maximum size of the individual blocks
+     * \param offset
+     *      Offset of the crop window within the image
+     * \param passBegin
+     *      Index of the first rendering pass. Each pass renders all blocks
+     *      once, using different samples (see \ref Sampler::prepare()).
+     * \param passEnd
+     *      One past the index of the last rendering pass
      */
-    BlockGenerator(const Vector2i &size, int blockSize);
+    BlockGenerator(const Vector2i &size, int blockSize,
+                   const Point2i &offset = Point2i(0, 0),
+                   uint32_t passBegin = 0, uint32_t passEnd = 1);
     
     /**
      * \brief Return the next block to be rendered
      *
-     * This function is thread-safe
+     * This function is thread-safe and lock-free
      *
      * \return \c false if there were no more blocks
      */
     bool next(ImageBlock &block);
 
-    /// Return the total number of blocks
-    int getBlockCount() const { return m_blocksLeft; }
+    /**
+     * \brief Return the next block to be rendered along with its index
+     *
+     * Blocks that have previously been marked as completed (e.g. when
+     * resuming from a checkpoint) are skipped.
+     */
+    bool next(ImageBlock &block, int &index);
+
+    /// Return the total number of blocks (over all passes)
+    int getBlockCount() const { return (int) m_blocks.size(); }
+
+    /// Return the rendering pass of the block with the given index
+    uint32_t getPass(int index) const { return m_blocks[index].pass; }
+
+    /// Return the offset of the region that is split into blocks
+    const Point2i &getOffset() const { return m_offset; }
+
+    /// Return the size of the region that is split into blocks
+    const Vector2i &getSize() const { return m_size; }
+
+    /// Return the index of the first rendering pass
+    uint32_t getPassBegin() const { return m_passBegin; }
+
+    /// Return one past the index of the last rendering pass
+    uint32_t getPassEnd() const { return m_passEnd; }
+
+    /**
+     * \brief Return the index of the first block of the given pass
+     *
+     * The blocks are ordered by pass, but passes may consist of different
+     * numbers of blocks (since only the blocks at the end of the sequence
+     * are split). \c getPassOffset(getPassEnd()) returns the block count.
+     */
+    int getPassOffset(uint32_t pass) const { return m_passOffsets[pass - m_passBegin]; }
+
+    /**
+     * \brief Mark the block with the given index as completed
+     *
+     * This function is thread-safe as long as it is not invoked
+     * concurrently for the same index.
+     */
+    void setCompleted(int index) { m_completed[index] = 1; }
+
+    /// Has the block with the given index been completed?
+    bool isCompleted(int index) const { return m_completed[index] != 0; }
 protected:
-    enum EDirection { ERight = 0, EDown, ELeft, EUp };
+    struct Block {
+        Point2i offset;
+        Vector2i size;
+        uint32_t pass;
+    };
 
-    Point2i m_block;
-    Vector2i m_numBlocks;
+    Point2i m_offset;
     Vector2i m_size;
-    int m_blockSize;
-    int m_numSteps;
-    int m_blocksLeft;
-    int m_stepsLeft;
-    int m_direction;
-    tbb::mutex m_mutex;
+    uint32_t m_passBegin, m_passEnd;
+    std::vector<Block> m_blocks;
+    std::vector<int> m_passOffsets;
+    std::vector<uint8_t> m_completed;
+    std::atomic<int> m_nextBlock;
 };
 
 NORI_NAMESPACE_END
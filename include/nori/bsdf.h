@@ -118,6 +118,16 @@ public:
      * or not to store photons on a surface
      */
     virtual bool isDiffuse() const { return false; }
+
+    /**
+     * \brief Return the approximate reflectance of the surface at
+     * the given intersection
+     *
+     * This is used as a feature buffer that guides the denoiser. The
+     * default implementation (suitable for specular materials) returns
+     * white.
+     */
+    virtual Color3f getAlbedo(const Intersection &/* its */) const { return Color3f(1.0f); }
 };
 
 NORI_NAMESPACE_END
@@ -63,6 +63,20 @@ public:
     /// Return the camera's reconstruction filter in image space
     const ReconstructionFilter *getReconstructionFilter() const { return m_rfilter; }
 
+    /**
+     * \brief Return the number of views rendered by this camera
+     *
+     * A camera can describe a path (e.g. a turntable) consisting of
+     * several views. Such cameras are replaced by one camera per view
+     * when the scene is activated (see \ref createView()).
+     */
+    virtual size_t getViewCount() const { return 1; }
+
+    /// Create a new camera that renders the view with the given index
+    virtual Camera *createView(size_t /* index */) const {
+        throw NoriException("Camera::createView(): camera paths are not supported!");
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Camera/etc.) 
      * provided by this instance
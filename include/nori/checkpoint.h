@@ -0,0 +1,125 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <nori/block.h>
+#include <nori/sampler.h>
+#include <tbb/spin_rw_mutex.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Checkpointing support for long-running renderings
+ *
+ * This class periodically captures everything that is needed to resume
+ * an interrupted rendering: the accumulated (i.e. unnormalized) film
+ * including its weight channel and border region, any auxiliary films
+ * (e.g. feature buffers), and the set of blocks that have already been
+ * merged into them.
+ *
+ * The sampler state does not need to be stored: samplers deterministically
+ * initialize themselves from the offset and pass of each block in \ref
+ * Sampler::prepare(), so the remaining blocks of a resumed rendering
+ * receive exactly the same samples as in an uninterrupted run.
+ *
+ * To guarantee that the film and the list of completed blocks are
+ * consistent with each other, rendering threads must merge their blocks
+ * through \ref put(). Merges never wait for each other; they are only
+ * held up for the short time it takes \ref save() to copy the film.
+ */
+class Checkpoint {
+public:
+    /**
+     * \brief Create a new checkpoint manager
+     *
+     * \param filename
+     *     Name of the checkpoint file
+     * \param film
+     *     Image block that holds the entire rendered image
+     * \param generator
+     *     Block generator that is used to schedule the rendering
+     * \param sampler
+     *     Sampler of the rendering. Its type, seed and number of samples
+     *     per pixel are used to detect checkpoints that belong to a
+     *     differently configured rendering.
+     */
+    Checkpoint(const std::string &filename, ImageBlock &film,
+               BlockGenerator &generator, const Sampler &sampler);
+
+    /// Register an auxiliary film of the same size that is stored in the checkpoint
+    void addFilm(ImageBlock &film) { m_films.push_back(&film); }
+
+    /// Return the number of films (the main film and all auxiliary films)
+    size_t getFilmCount() const { return m_films.size(); }
+
+    /**
+     * \brief Merge a rendered block into the film and record
+     * it as completed (only if there are no auxiliary films)
+     *
+     * This function is thread-safe.
+     */
+    void put(ImageBlock &block, int index) {
+        ImageBlock *blocks[] = { &block };
+        put(blocks, index);
+    }
+
+    /**
+     * \brief Merge a set of rendered blocks (one for each film, in the
+     * order of registration) and record them as completed
+     *
+     * This function is thread-safe.
+     */
+    void put(ImageBlock * const *blocks, int index);
+
+    /**
+     * \brief Write a checkpoint of the current rendering state
+     *
+     * The checkpoint is first written to a temporary file, which is
+     * flushed to disk and then replaces the previous checkpoint. Hence,
+     * an interruption at any point (even a crash of the host) never
+     * leaves behind a corrupted checkpoint file.
+     */
+    void save();
+
+    /**
+     * \brief Restore the rendering state from the checkpoint file
+     *
+     * \return \c false if there was no checkpoint file
+     */
+    bool load();
+
+    /// Remove the checkpoint file (e.g. once rendering has finished)
+    void remove();
+
+    /// Return the number of blocks that were completed in the checkpoint
+    int getCompletedBlockCount() const;
+
+    /// Return the name of the checkpoint file
+    const std::string &getFilename() const { return m_filename; }
+private:
+    std::string m_filename;
+    std::vector<ImageBlock *> m_films;
+    BlockGenerator &m_generator;
+    uint32_t m_sampleCount;
+    std::string m_samplerType;
+    uint32_t m_seed;
+    tbb::spin_rw_mutex m_mutex;
+};
+
+NORI_NAMESPACE_END
@@ -49,6 +49,9 @@
 /* "Ray epsilon": relative error threshold for ray intersection computations */
 #define Epsilon 1e-4f
 
+/* Largest float that is smaller than one (i.e. 1 - 2^-24) */
+#define OneMinusEpsilon 0.99999994f
+
 /* A few useful constants */
 #undef M_PI
 
@@ -121,6 +124,7 @@ class BSDF;
 class Bitmap;
 class BlockGenerator;
 class Camera;
+class Denoiser;
 class ImageBlock;
 class Integrator;
 class KDTree;
@@ -187,6 +191,12 @@ extern std::string timeString(double time, bool precise = false);
 /// Convert a memory amount in bytes into a human-readable string
 extern std::string memString(size_t size, bool precise = false);
 
+/**
+ * \brief Return the peak amount of physical memory (in bytes) that
+ * was used by the process so far, or zero if this is not supported
+ */
+extern size_t getPeakMemoryUsage();
+
 /// Measures associated with probability distributions
 enum EMeasure {
     EUnknownMeasure = 0,
@@ -257,6 +267,9 @@ extern Point2f sphericalCoordinates(const Vector3f &dir);
  */
 extern float fresnel(float cosThetaI, float extIOR, float intIOR);
 
+/// Inverse of the error function (single precision approximation by M. Giles)
+extern float erfinv(float x);
+
 /**
  * \brief Return the global file resolver instance
  *
@@ -265,4 +278,33 @@ extern float fresnel(float cosThetaI, float extIOR, float intIOR);
  */
 extern filesystem::resolver *getFileResolver();
 
+/**
+ * \brief Return the time of the last modification of a file
+ *
+ * The value is only meaningful for comparisons with other values
+ * returned by this function. It has sub-second resolution where the
+ * file system provides it. Returns -1 if the file does not exist.
+ */
+extern int64_t getFileModificationTime(const std::string &filename);
+
+/**
+ * \brief Start collecting the names of all files that are read while
+ * loading a scene (see \ref addFileDependency())
+ *
+ * This is used by the render server to find out when a cached scene
+ * must be reloaded. Only one recording can be active at a time.
+ */
+extern void startFileDependencyRecording();
+
+/// Stop collecting file names and return the ones recorded since the start
+extern std::vector<std::string> stopFileDependencyRecording();
+
+/**
+ * \brief Report that a file was read while loading a scene
+ *
+ * Objects call this for every external file they read (meshes, textures,
+ * ...). Does nothing unless a recording is active. Thread-safe.
+ */
+extern void addFileDependency(const std::string &filename);
+
 NORI_NAMESPACE_END
@@ -0,0 +1,60 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <nori/object.h>
+#include <nori/bitmap.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Superclass of all image-space denoisers
+ *
+ * A denoiser is declared as a child of the scene and post-processes the
+ * final image. Besides the noisy image, it receives feature buffers that
+ * were recorded at the first intersection along each camera ray and are
+ * far less noisy than the image itself: the surface albedo, the shading
+ * normal and the hit distance (zero where the ray escaped).
+ */
+class Denoiser : public NoriObject {
+public:
+    /**
+     * \brief Denoise an image in place
+     *
+     * \param image
+     *     The rendered (noisy) image
+     * \param albedo
+     *     Surface reflectance at the first intersection (see \ref BSDF::getAlbedo())
+     * \param normal
+     *     World-space shading normal at the first intersection
+     * \param depth
+     *     Distance to the first intersection (stored in all three channels)
+     */
+    virtual void denoise(Bitmap &image, const Bitmap &albedo,
+                         const Bitmap &normal, const Bitmap &depth) const = 0;
+
+    /**
+     * \brief Return the type of object (i.e. Mesh/BSDF/etc.)
+     * provided by this instance
+     * */
+    EClassType getClassType() const { return EDenoiser; }
+};
+
+NORI_NAMESPACE_END
@@ -40,6 +40,36 @@ public:
 
 	virtual Point2f sample2D() const =0;
 
+	/**
+	 * \brief Does this emitter illuminate the scene from infinitely far
+	 * away (e.g. an environment map)?
+	 *
+	 * Such emitters are not attached to a mesh. They provide the radiance
+	 * of rays that escape the scene through the functions below.
+	 */
+	virtual bool isEnvironment() const { return false; }
+
+	/// Return the radiance that arrives along a ray with direction \c d that escapes the scene
+	virtual Color3f evalEnvironment(const Vector3f &/* d */) const { return Color3f(0.0f); }
+
+	/**
+	 * \brief Sample the direction of a ray that escapes towards the emitter
+	 *
+	 * \param d       The sampled direction (in world space)
+	 * \param pdf     Probability density of \c d with respect to solid angles
+	 * \param sample  A uniformly distributed sample on \f$[0,1]^2\f$
+	 *
+	 * \return The radiance along \c d divided by \c pdf (zero if
+	 *         sampling failed)
+	 */
+	virtual Color3f sampleEnvironment(Vector3f &/* d */, float &pdf, const Point2f &/* sample */) const {
+		pdf = 0.0f;
+		return Color3f(0.0f);
+	}
+
+	/// Probability density of \ref sampleEnvironment() with respect to solid angles
+	virtual float pdfEnvironment(const Vector3f &/* d */) const { return 0.0f; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Emitter/etc.) 
      * provided by this instance
@@ -18,21 +18,26 @@
 
 #pragma once
 
-#include <nori/common.h>
+#include <nori/block.h>
+#include <nori/progress.h>
 #include <nanogui/screen.h>
 
 NORI_NAMESPACE_BEGIN
 
 class NoriScreen : public nanogui::Screen {
 public:
-    NoriScreen(const ImageBlock &block);
+    /// Show the partially rendered image (and optionally the progress of the rendering)
+    NoriScreen(const ImageBlock &block, const RenderProgress *progress = nullptr);
     virtual ~NoriScreen();
 
     void drawContents();
 private:
     const ImageBlock &m_block;
+    ImageBlock::Base m_snapshot;
     nanogui::GLShader *m_shader = nullptr;
     nanogui::Slider *m_slider = nullptr;
+    const RenderProgress *m_progress;
+    nanogui::Label *m_progressLabel = nullptr;
     uint32_t m_texture = 0;
     float m_scale = 1.f;
 };
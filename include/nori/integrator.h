@@ -53,6 +53,33 @@ public:
      *    A (usually) unbiased estimate of the radiance in this direction
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
+
+    /**
+     * \brief Sample the incident radiance along a ray and record
+     * the arbitrary output variables (AOVs)
+     *
+     * Integrators should override this function and fill the standard
+     * AOVs using \ref Scene::evalAOVs() with their first intersection.
+     * The default implementation traces an additional ray to find it and
+     * then calls the above function.
+     *
+     * \param aovs
+     *    Array with one entry per name returned by \ref Scene::getAOVNames(),
+     *    followed by one per name returned by \ref getAOVNames(), which
+     *    is filled with the values associated with \c ray
+     */
+    virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                       Color3f *aovs) const;
+
+    /**
+     * \brief Return the names of the AOVs (e.g. separate lighting
+     * components) produced by this integrator
+     *
+     * These are written to the output as additional layers besides the
+     * standard AOVs of the scene (see \ref Scene::getAOVNames()).
+     */
+    virtual std::vector<std::string> getAOVNames() const { return std::vector<std::string>(); }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
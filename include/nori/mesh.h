@@ -26,9 +26,13 @@
 #include <time.h>
 #include <nori/common.h>
 #include <nori/areadist.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
+/// Number of positions sampled on emitting meshes
+NORI_STAT_EXTERN_COUNTER(statEmitterSamples);
+
 /**
  * \brief Intersection data structure
  *
@@ -44,6 +48,8 @@ struct Intersection {
     float t;
     /// UV coordinates, if any
     Point2f uv;
+    /// Width of the ray footprint in UV space (for texture filtering, zero: unknown)
+    float uvWidth;
     /// Shading frame (based on the shading normal)
     Frame shFrame;
     /// Geometric frame (based on the true geometry)
@@ -52,7 +58,7 @@ struct Intersection {
     const Mesh *mesh;
 
     /// Create an uninitialized intersection record
-    Intersection() : mesh(nullptr) { }
+    Intersection() : uvWidth(0.0f), mesh(nullptr) { }
 
     /// Transform a direction vector into the local shading frame
     Vector3f toLocal(const Vector3f &d) const {
@@ -68,6 +74,43 @@ struct Intersection {
     std::string toString() const;
 };
 
+/**
+ * \brief Compact record of a ray-triangle intersection
+ *
+ * This is what the acceleration data structure produces while searching
+ * for the closest intersection. The position, texture coordinates and
+ * frames of the full \ref Intersection record are only computed on demand
+ * by \ref computeIntersection(), since many queries (e.g. depth or
+ * visibility) do not need them.
+ */
+struct HitRecord {
+    /// Unoccluded distance along the ray
+    float t;
+    /// Barycentric coordinates of the intersection within the triangle
+    Point2f bary;
+    /// Index of the triangle within its mesh
+    uint32_t triangle;
+    /// Pointer to the associated mesh
+    const Mesh *mesh;
+
+    /// Create an uninitialized hit record
+    HitRecord() : triangle(0), mesh(nullptr) { }
+
+    /// Compute the full intersection record (position, UV coordinates and frames)
+    void computeIntersection(Intersection &its) const;
+
+    /**
+     * \brief Compute the width of the footprint of \c ray in UV space
+     *
+     * Approximates the ray by a cone with the spread angle \c ray.spread
+     * (a "ray cone"). Its width at the intersection is projected onto the
+     * triangle and converted into UV units using the ratio of the
+     * triangle's UV and surface areas. Returns zero for rays without a
+     * spread angle.
+     */
+    float computeUVWidth(const Ray3f &ray, const Intersection &its) const;
+};
+
 /**
  * \brief Triangle mesh
  *
@@ -170,7 +213,8 @@ public:
 	* */
 	virtual void sample(Point3f &p, Normal3f &n, float &pd, Point2f unif2d, float unif1d) const
 	{
-		
+		NORI_STAT_ADD(statEmitterSamples, 1);
+
 		float xi_1 = unif2d.x(), xi_2 = unif2d.y();
 
 
@@ -226,4 +270,14 @@ protected:
 
 };
 
+/**
+ * \brief Keep the contents of loaded OBJ files in memory, so that subsequent
+ * loads of files that have not changed in the meantime skip parsing them
+ *
+ * This is used by Nori's render server mode, which repeatedly loads the
+ * same scenes. It is disabled by default, since the cache holds a second
+ * copy of all geometry. Disabling the cache releases its contents.
+ */
+extern void setOBJCacheEnabled(bool enabled);
+
 NORI_NAMESPACE_END
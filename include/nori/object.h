@@ -42,6 +42,8 @@ public:
         ESampler,
         ETest,
         EReconstructionFilter,
+        ETexture,
+        EDenoiser,
         EClassTypeCount
     };
 
@@ -98,6 +100,8 @@ public:
             case EIntegrator: return "integrator";
             case ESampler:    return "sampler";
             case ETest:       return "test";
+            case ETexture:    return "texture";
+            case EDenoiser:   return "denoiser";
             default:          return "<unknown>";
         }
     }
@@ -145,6 +149,9 @@ public:
             throw NoriException("A constructor for class \"%s\" could not be found!", name);
         return (*m_constructors)[name](propList);
     }
+
+    /// Return the names of all registered classes (in alphabetical order)
+    static std::vector<std::string> getClassNames();
 private:
     static std::map<std::string, Constructor> *m_constructors;
 };
@@ -28,4 +28,16 @@ NORI_NAMESPACE_BEGIN
  */
 extern NoriObject *loadFromXML(const std::string &filename);
 
+/**
+ * \brief Load a scene (or any other Nori object) from an XML
+ * description stored in memory and return its root object
+ *
+ * \param contents
+ *     The XML description
+ * \param filename
+ *     Name used to refer to the description in error messages
+ */
+extern NoriObject *loadFromXMLString(const std::string &contents,
+                                     const std::string &filename);
+
 NORI_NAMESPACE_END
@@ -0,0 +1,131 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <nori/common.h>
+#include <pcg32.h>
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Fill an array with consecutive outputs of \ref pcg32::nextFloat()
+ *
+ * Long runs are generated by eight interleaved lanes: lane \c k produces
+ * the outputs \c k, \c k+8, \c k+16, ... of the stream, so that all lanes
+ * can be advanced in parallel (using AVX2 if Nori is compiled with the
+ * \c NORI_USE_AVX2 option). The results are bit-identical to calling
+ * \ref pcg32::nextFloat() \c count times, and \c rng ends up in the same
+ * state, hence batched and scalar requests can be mixed freely.
+ */
+inline void pcg32NextFloats(pcg32 &rng, float *values, size_t count) {
+    const size_t Lanes = 8;
+
+    /* Setting up the lanes only pays off for longer runs */
+    if (count < 2 * Lanes) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = rng.nextFloat();
+        return;
+    }
+
+    /* Lane k starts k steps ahead of the generator */
+    uint64_t state[Lanes];
+    uint64_t mult = 1u, plus = 0u;
+    for (size_t k = 0; k < Lanes; ++k) {
+        state[k] = mult * rng.state + plus;
+        plus = plus * PCG32_MULT + rng.inc;
+        mult *= PCG32_MULT;
+    }
+    /* 'mult' and 'plus' now advance a state by 'Lanes' steps */
+
+    size_t blocks = count / Lanes;
+
+#if defined(__AVX2__)
+    /* The low 64 bits of a 64x64 bit product, using 32x32 bit multiplies */
+    auto mul64 = [](__m256i a, __m256i b) {
+        __m256i lo = _mm256_mul_epu32(a, b);
+        __m256i cross = _mm256_add_epi64(
+            _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+            _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+        return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+    };
+
+    const __m256i vmult = _mm256_set1_epi64x((long long) mult),
+                  vplus = _mm256_set1_epi64x((long long) plus),
+                  mask = _mm256_set1_epi64x(0xFFFFFFFFll),
+                  thirtyTwo = _mm256_set1_epi64x(32),
+                  thirtyOne = _mm256_set1_epi64x(31),
+                  one = _mm256_set1_epi64x(0x3f800000ll),
+                  pack = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m128 ones = _mm_set1_ps(1.0f);
+
+    __m256i s[2] = {
+        _mm256_loadu_si256((const __m256i *) state),
+        _mm256_loadu_si256((const __m256i *) (state + 4))
+    };
+
+    for (size_t b = 0; b < blocks; ++b) {
+        for (int h = 0; h < 2; ++h) {
+            __m256i old = s[h];
+            s[h] = _mm256_add_epi64(mul64(old, vmult), vplus);
+
+            /* Output function: XSH RR */
+            __m256i xorshifted = _mm256_and_si256(_mm256_srli_epi64(
+                _mm256_xor_si256(_mm256_srli_epi64(old, 18), old), 27), mask);
+            __m256i rot = _mm256_srli_epi64(old, 59);
+            __m256i result = _mm256_and_si256(_mm256_or_si256(
+                _mm256_srlv_epi64(xorshifted, rot),
+                _mm256_sllv_epi64(xorshifted, _mm256_and_si256(_mm256_sub_epi64(thirtyTwo, rot), thirtyOne))),
+                mask);
+
+            /* Convert to a float in [1, 2) and subtract one */
+            result = _mm256_or_si256(_mm256_srli_epi64(result, 9), one);
+            __m128 f = _mm_castsi128_ps(_mm256_castsi256_si128(
+                _mm256_permutevar8x32_epi32(result, pack)));
+            _mm_storeu_ps(values + b * Lanes + 4 * h, _mm_sub_ps(f, ones));
+        }
+    }
+#else
+    /* Portable version (amenable to auto-vectorization) */
+    for (size_t b = 0; b < blocks; ++b) {
+        for (size_t k = 0; k < Lanes; ++k) {
+            uint64_t old = state[k];
+            state[k] = old * mult + plus;
+            uint32_t xorshifted = (uint32_t) (((old >> 18u) ^ old) >> 27u);
+            uint32_t rot = (uint32_t) (old >> 59u);
+            union {
+                uint32_t u;
+                float f;
+            } x;
+            x.u = (((xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31))) >> 9) | 0x3f800000u;
+            values[b * Lanes + k] = x.f - 1.0f;
+        }
+    }
+#endif
+
+    /* Continue with the scalar generator for the remainder */
+    rng.advance((int64_t) (blocks * Lanes));
+    for (size_t i = blocks * Lanes; i < count; ++i)
+        values[i] = rng.nextFloat();
+}
+
+NORI_NAMESPACE_END
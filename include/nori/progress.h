@@ -0,0 +1,110 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <nori/timer.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Keeps track of the progress of a rendering
+ *
+ * The rendering threads report every completed image block along with
+ * the number of samples and rays that it took, which only costs a few
+ * relaxed atomic additions per block. The percentage of completed blocks,
+ * the throughput (in Msamples/s and Mrays/s) and the estimated remaining
+ * time can be queried at any time, e.g. by the user interface, or they
+ * can be printed periodically by a background thread.
+ */
+class RenderProgress {
+public:
+    /// Format of the periodically printed progress lines
+    enum EFormat {
+        /// Human-readable summary
+        EText = 0,
+
+        /// One line of 'key=value' pairs starting with "progress"
+        EMachine
+    };
+
+    /// Snapshot of the progress of the rendering
+    struct Status {
+        /// Fraction of the blocks that have been completed (including resumed ones)
+        float fraction;
+
+        /// Samples and rays per second (since the rendering started)
+        double samplesPerSecond, raysPerSecond;
+
+        /// Elapsed and estimated remaining time in milliseconds
+        double elapsed, remaining;
+    };
+
+    /**
+     * \brief Create a progress tracker for the given number of blocks
+     *
+     * \param completedBlockCount
+     *    Number of blocks that had already been completed before (e.g. in
+     *    a checkpoint). They count towards the percentage but not towards
+     *    the throughput.
+     */
+    RenderProgress(int blockCount, int completedBlockCount = 0);
+
+    /// Stop printing the progress
+    ~RenderProgress();
+
+    /// Record a completed block (called by the rendering threads)
+    void update(int64_t sampleCount, int64_t rayCount) {
+        m_samples.fetch_add(sampleCount, std::memory_order_relaxed);
+        m_rays.fetch_add(rayCount, std::memory_order_relaxed);
+        m_blocks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Return a snapshot of the progress
+    Status getStatus() const;
+
+    /// Return a human-readable summary of the progress
+    std::string toString() const;
+
+    /// Return a machine-readable summary of the progress
+    std::string toMachineString() const;
+
+    /// Print the progress to \c os every \c interval seconds until \ref stop() is called
+    void start(float interval, EFormat format, std::ostream &os = std::cout);
+
+    /// Stop printing the progress
+    void stop();
+private:
+    int m_blockCount, m_resumedBlockCount;
+    Timer m_timer;
+
+    /* All counters are updated at the same time, hence they share a cache line */
+    std::atomic<int> m_blocks;
+    std::atomic<int64_t> m_samples, m_rays;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+};
+
+NORI_NAMESPACE_END
@@ -44,29 +44,30 @@ template <typename _PointType, typename _VectorType> struct TRay {
     VectorType dRcp; ///< Componentwise reciprocals of the ray direction
     Scalar mint;     ///< Minimum position on the ray segment
     Scalar maxt;     ///< Maximum position on the ray segment
+    Scalar spread;   ///< Spread angle of the ray cone (texture filtering, zero: none)
 	int depth;
 
 
     /// Construct a new ray
     TRay() : mint(Epsilon), 
-		maxt(std::numeric_limits<Scalar>::infinity()) {
+		maxt(std::numeric_limits<Scalar>::infinity()), spread(0) {
 		depth = 0;
 	}
     
     /// Construct a new ray
     TRay(const PointType &o, const VectorType &d) : o(o), d(d), 
-            mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()) {
+            mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()), spread(0) {
 		depth = 0;
         update();
     }
 
 	TRay(const PointType &o, const VectorType &d, int depth) : o(o), d(d),
-		mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()),depth(depth) {
+		mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()), spread(0), depth(depth) {
 		update();
 	}
     /// Construct a new ray
     TRay(const PointType &o, const VectorType &d, 
-        Scalar mint, Scalar maxt) : o(o), d(d), mint(mint), maxt(maxt) {
+        Scalar mint, Scalar maxt) : o(o), d(d), mint(mint), maxt(maxt), spread(0) {
 		depth = 0;
         update();
     }
@@ -74,11 +75,12 @@ template <typename _PointType, typename _VectorType> struct TRay {
     /// Copy constructor
     TRay(const TRay &ray) 
      : o(ray.o), d(ray.d), dRcp(ray.dRcp),
-       mint(ray.mint), maxt(ray.maxt), depth(ray.depth) { }
+       mint(ray.mint), maxt(ray.maxt), spread(ray.spread), depth(ray.depth) { }
 
     /// Copy a ray, but change the covered segment of the copy
     TRay(const TRay &ray, Scalar mint, Scalar maxt) 
-     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt), depth(ray.depth) { }
+     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt),
+       spread(ray.spread), depth(ray.depth) { }
 
     /// Update the reciprocal ray directions after changing 'd'
     void update() {
@@ -93,6 +95,7 @@ template <typename _PointType, typename _VectorType> struct TRay {
         TRay result;
         result.o = o; result.d = -d; result.dRcp = -dRcp;
         result.mint = mint; result.maxt = maxt;
+        result.spread = spread;
         return result;
     }
 
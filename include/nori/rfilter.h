@@ -36,6 +36,13 @@ NORI_NAMESPACE_BEGIN
  * which is freely available at:
  *
  * http://graphics.stanford.edu/~mmp/chapters/pbrt_chapter7.pdf
+ *
+ * All filters accept a boolean \c importanceSampling parameter. When it
+ * is set, the film does not splat samples into neighboring pixels.
+ * Instead, sample positions are warped according to the (absolute value
+ * of the) filter, and each sample only contributes to the pixel that
+ * generated it. Negative filter lobes are accounted for by assigning
+ * negative sample weights.
  */
 class ReconstructionFilter : public NoriObject {
 public:
@@ -45,6 +52,9 @@ public:
     /// Evaluate the filter function
     virtual float eval(float x) const = 0;
 
+    /// Should the film importance sample this filter instead of splatting?
+    bool isImportanceSampled() const { return m_importanceSampled; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Camera/etc.) 
      * provided by this instance
@@ -52,6 +62,7 @@ public:
     EClassType getClassType() const { return EReconstructionFilter; }
 protected:
     float m_radius;
+    bool m_importanceSampled = false;
 };
 
 NORI_NAMESPACE_END
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <nori/object.h>
+#include <initializer_list>
 #include <memory>
 
 NORI_NAMESPACE_BEGIN
@@ -48,7 +49,9 @@ class ImageBlock;
  * \ref advance() needs to be invoked. This repeats until all pixel samples have
  * been exhausted.  While computing a pixel sample, the rendering 
  * algorithm requests (pseudo-) random numbers using the \ref next1D() and
- * \ref next2D() functions.
+ * \ref next2D() functions. Each such request consumes one dimension of
+ * the current sample; \ref generate() and \ref advance() rewind to the
+ * first dimension.
  *
  * Conceptually, the right way of thinking of this goes as follows:
  * For each sample in a pixel, a sample generator produces a (hypothetical)
@@ -74,16 +77,30 @@ public:
      * a new image block. This can be used to deterministically
      * initialize the sampler so that repeated program runs
      * always create the same image.
+     *
+     * \param pass
+     *     Index of the current rendering pass. Renderings can be split
+     *     into several passes (possibly rendered by different processes),
+     *     which must each receive a different set of samples.
      */
-    virtual void prepare(const ImageBlock &block) = 0;
+    virtual void prepare(const ImageBlock &block, uint32_t pass) = 0;
 
     /**
      * \brief Prepare to generate new samples
      * 
      * This function is called initially and every time the 
      * integrator starts rendering a new pixel.
+     *
+     * Implementations should derive the samples from the pixel, the
+     * index of the sample and the dimension (and the pass) only, so that
+     * a rendering does not depend on the block size or on the order in
+     * which threads process the pixels.
+     *
+     * \param pixel
+     *     Integer coordinates of the pixel (used by samplers that
+     *     decorrelate the sample patterns of different pixels)
      */
-    virtual void generate() = 0;
+    virtual void generate(const Point2i &pixel) = 0;
 
     /// Advance to the next sample
     virtual void advance() = 0;
@@ -94,15 +111,62 @@ public:
     /// Retrieve the next two component values from the current sample
     virtual Point2f next2D() = 0;
 
+    /**
+     * \brief Retrieve the next \c count component values from the
+     * current sample
+     *
+     * This is equivalent to \c count calls to \ref next1D(), but only
+     * involves a single virtual function call. Samplers can override
+     * it to generate the values in bulk.
+     */
+    virtual void next1DArray(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next1D();
+    }
+
+    /**
+     * \brief Retrieve the next \c count pairs of component values from
+     * the current sample (equivalent to \c count calls to \ref next2D())
+     */
+    virtual void next2DArray(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next2D();
+    }
+
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /// Change the number of configured pixel samples
+    virtual void setSampleCount(size_t sampleCount) { m_sampleCount = sampleCount; }
+
+    /// Return the seed that decorrelates the samples of different renderings
+    virtual uint32_t getSeed() const { return 0; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
      * */
     EClassType getClassType() const { return ESampler; }
 protected:
+    /**
+     * \brief Hash a set of integers (e.g. a pixel position, a pass and
+     * the index of a dimension) into a well-distributed 32-bit value
+     *
+     * This is useful to derive seeds for per-pixel and per-dimension
+     * scrambling of sample patterns.
+     */
+    static uint32_t hash(std::initializer_list<uint32_t> values) {
+        uint32_t h = 0x9e3779b9u;
+        for (uint32_t value : values) {
+            h ^= value + 0x9e3779b9u + (h << 6) + (h >> 2);
+            /* Finalizer with a low bias (by Chris Wellons) */
+            h ^= h >> 16; h *= 0x7feb352du;
+            h ^= h >> 15; h *= 0x846ca68bu;
+            h ^= h >> 16;
+        }
+        return h;
+    }
+
     size_t m_sampleCount;
 };
 
@@ -58,8 +58,55 @@ public:
     /// Return a pointer to the scene's integrator
     Integrator *getIntegrator() { return m_integrator; }
 
-    /// Return a pointer to the scene's camera
-    const Camera *getCamera() const { return m_camera; }
+    /// Return a pointer to one of the scene's cameras (by default, the first one)
+    const Camera *getCamera(size_t index = 0) const { return m_cameras[index]; }
+
+    /// Return the number of cameras (i.e. views that are rendered)
+    size_t getCameraCount() const { return m_cameras.size(); }
+
+    /**
+     * \brief Replace the scene's cameras
+     *
+     * The scene takes ownership of \c cameras. The previous cameras are
+     * returned, and the caller becomes responsible for releasing them.
+     */
+    std::vector<Camera *> setCameras(const std::vector<Camera *> &cameras) {
+        std::vector<Camera *> previous = m_cameras;
+        m_cameras = cameras;
+        return previous;
+    }
+
+    /**
+     * \brief Return the names of the standard arbitrary output variables
+     * (AOVs) that are recorded along with the rendered image
+     *
+     * They are requested using the scene's \c aovs property, e.g.
+     * \c "albedo, normal, depth". Supported are \c albedo, \c normal,
+     * \c depth, \c position and \c uv. The features that guide the
+     * denoiser are always included if there is one.
+     */
+    const std::vector<std::string> &getAOVNames() const { return m_aovNames; }
+
+    /**
+     * \brief Evaluate the standard AOVs at the first intersection
+     * along a camera ray
+     *
+     * Integrators call this from \ref Integrator::Li() with the
+     * intersection that they have found anyway, so that no additional
+     * ray needs to be traced.
+     *
+     * \param its
+     *    First intersection along the ray (\c nullptr if it escaped)
+     * \param values
+     *    Array with one entry per name returned by \ref getAOVNames()
+     */
+    void evalAOVs(const Intersection *its, Color3f *values) const;
+
+    /// Return a pointer to the scene's environment emitter (or \c nullptr if there is none)
+    const Emitter *getEnvironment() const { return m_environment; }
+
+    /// Return a pointer to the scene's denoiser (or \c nullptr if there is none)
+    const Denoiser *getDenoiser() const { return m_denoiser; }
 
     /// Return a pointer to the scene's sample generator (const version)
     const Sampler *getSampler() const { return m_sampler; }
@@ -88,6 +135,20 @@ public:
         return m_accel->rayIntersect(ray, its, false);
     }
 
+    /**
+     * \brief Intersect a ray against all triangles stored in the scene
+     * and only return a compact record of the closest intersection
+     *
+     * This avoids computing the position, texture coordinates and frames
+     * of the intersection, which can be done later (if needed) using
+     * \ref HitRecord::computeIntersection().
+     *
+     * \return \c true if an intersection was found
+     */
+    bool rayIntersect(const Ray3f &ray, HitRecord &hit) const {
+        return m_accel->rayIntersect(ray, hit);
+    }
+
     /**
      * \brief Intersect a ray against all triangles stored in the scene
      * and \a only determine whether or not there is an intersection.
@@ -104,8 +165,7 @@ public:
      * \return \c true if an intersection was found
      */
     bool rayIntersect(const Ray3f &ray) const {
-        Intersection its; /* Unused */
-        return m_accel->rayIntersect(ray, its, true);
+        return m_accel->rayIntersect(ray);
     }
 
     /// \brief Return an axis-aligned box that bounds the scene
@@ -132,11 +192,15 @@ private:
     std::vector<Mesh *> m_meshes;
     Integrator *m_integrator = nullptr;
     Sampler *m_sampler = nullptr;
-    Camera *m_camera = nullptr;
+    std::vector<Camera *> m_cameras;
     Accel *m_accel = nullptr;
+    Denoiser *m_denoiser = nullptr;
+    std::vector<std::string> m_aovNames;
+    std::vector<int> m_aovTypes;
 
 	/**** modified ****/
 	std::vector<Emitter *>m_emitters;
+	Emitter *m_environment = nullptr;
 };
 
 NORI_NAMESPACE_END
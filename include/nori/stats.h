@@ -0,0 +1,159 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <nori/common.h>
+
+/**
+ * Statistics about the internals of the renderer (e.g. the number of rays
+ * of each type), in the style of pbrt's STAT_COUNTER. A statistic is
+ * defined at namespace scope in the source file that updates it:
+ *
+ * \code
+ * NORI_STAT_COUNTER(statShadowRays, "Rays", "Shadow rays");
+ * NORI_STAT_RATIO(statOccluded, "Rays", "Occluded shadow rays");
+ * NORI_STAT_HISTOGRAM(statDepth, "Integrator", "Path length", 16);
+ *
+ * NORI_STAT_ADD(statShadowRays, 1);
+ * NORI_STAT_RATIO_ADD(statOccluded, occluded ? 1 : 0, 1);
+ * NORI_STAT_HISTOGRAM_ADD(statDepth, depth);
+ * \endcode
+ *
+ * Statistics are only compiled in when Nori is built with the CMake option
+ * NORI_ENABLE_STATS. Otherwise, all of these macros expand to nothing (the
+ * arguments of the update macros are not even evaluated).
+ */
+
+#if defined(NORI_ENABLE_STATS)
+
+#include <mutex>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Registry of all statistics and of their per-thread values
+ *
+ * Every thread updates its own set of counter slots, which is allocated
+ * on first use and aligned to a cache line. Hence, updates are ordinary
+ * (non-atomic) increments that never contend with other threads. The
+ * per-thread values are only summed when a report is printed.
+ */
+class Statistics {
+public:
+    /// Maximum number of slots (ratios use two, histograms one per bucket)
+    static const int MaxSlots = 256;
+
+    enum EType {
+        ECounter = 0,
+        ERatio,
+        EHistogram
+    };
+
+    /// Register a statistic and return the index of its first slot
+    static int add(EType type, const char *category, const char *name, int slotCount);
+
+    /// Return the slots of the calling thread
+    static int64_t *getThreadSlots() {
+        static thread_local int64_t *slots = nullptr;
+        if (!slots)
+            slots = allocateThreadSlots();
+        return slots;
+    }
+
+    /// Print a table with the values of all statistics (summed over all threads)
+    static void print(std::ostream &os);
+
+    /// Reset all statistics to zero (must not be called while rendering)
+    static void reset();
+
+private:
+    static int64_t *allocateThreadSlots();
+};
+
+/// Statistic that counts the occurrences of an event
+class StatCounter {
+public:
+    StatCounter(const char *category, const char *name)
+        : m_slot(Statistics::add(Statistics::ECounter, category, name, 1)) { }
+
+    void add(int64_t value) const { Statistics::getThreadSlots()[m_slot] += value; }
+
+    /// Return the value accumulated by the calling thread
+    int64_t getThreadValue() const { return Statistics::getThreadSlots()[m_slot]; }
+private:
+    int m_slot;
+};
+
+/// Statistic that counts how often an event occurs out of a number of trials
+class StatRatio {
+public:
+    StatRatio(const char *category, const char *name)
+        : m_slot(Statistics::add(Statistics::ERatio, category, name, 2)) { }
+
+    void add(int64_t numerator, int64_t denominator) const {
+        int64_t *slots = Statistics::getThreadSlots();
+        slots[m_slot] += numerator;
+        slots[m_slot + 1] += denominator;
+    }
+private:
+    int m_slot;
+};
+
+/// Statistic that records the distribution of a non-negative integer value
+class StatHistogram {
+public:
+    /// Values that exceed the last bucket are recorded in the last bucket
+    StatHistogram(const char *category, const char *name, int bucketCount)
+        : m_slot(Statistics::add(Statistics::EHistogram, category, name, bucketCount)),
+          m_bucketCount(bucketCount) { }
+
+    void add(int64_t value) const {
+        int bucket = (int) std::min(std::max(value, (int64_t) 0), (int64_t) m_bucketCount - 1);
+        Statistics::getThreadSlots()[m_slot + bucket] += 1;
+    }
+private:
+    int m_slot;
+    int m_bucketCount;
+};
+
+NORI_NAMESPACE_END
+
+#define NORI_STAT_COUNTER(var, category, name) nori::StatCounter var(category, name)
+#define NORI_STAT_RATIO(var, category, name) nori::StatRatio var(category, name)
+#define NORI_STAT_HISTOGRAM(var, category, name, buckets) nori::StatHistogram var(category, name, buckets)
+
+/// Refer to a counter that is defined in another source file
+#define NORI_STAT_EXTERN_COUNTER(var) extern nori::StatCounter var
+
+#define NORI_STAT_ADD(var, value) var.add(value)
+#define NORI_STAT_RATIO_ADD(var, numerator, denominator) var.add(numerator, denominator)
+#define NORI_STAT_HISTOGRAM_ADD(var, value) var.add(value)
+
+#else
+
+#define NORI_STAT_COUNTER(var, category, name)
+#define NORI_STAT_RATIO(var, category, name)
+#define NORI_STAT_HISTOGRAM(var, category, name, buckets)
+#define NORI_STAT_EXTERN_COUNTER(var)
+
+#define NORI_STAT_ADD(var, value) do { } while (0)
+#define NORI_STAT_RATIO_ADD(var, numerator, denominator) do { } while (0)
+#define NORI_STAT_HISTOGRAM_ADD(var, value) do { } while (0)
+
+#endif
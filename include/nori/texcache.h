@@ -0,0 +1,143 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <nori/color.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Thread-safe cache of texture tiles with a memory budget
+ *
+ * Textures are stored as tiled mip-map pyramids, and their tiles are only
+ * loaded when they are first accessed. When the memory used by resident
+ * tiles exceeds the configured limit, the least recently used tiles are
+ * released. To keep lock contention low, the cache is split into several
+ * shards, each of which has its own lock, LRU list and share of the budget.
+ *
+ * In addition, every thread keeps references to the few tiles that it used
+ * most recently in a small direct-mapped table. Lookups that hit this table
+ * (e.g. the four texels of a bilinear lookup, or consecutive lookups by
+ * coherent rays) neither take a lock nor write to shared memory. Hence, the
+ * LRU order of the shards is only approximate: it is updated when a lookup
+ * misses the table of the calling thread. The tiles in these tables may
+ * exceed the memory budget by up to ThreadSlotCount tiles per thread.
+ */
+class TextureCache {
+public:
+    /// Width and height of a tile in texels
+    static const int TileSize = 64;
+
+    /// Number of tiles that are referenced by the table of each thread (a power of two)
+    static const int ThreadSlotCount = 8;
+
+    /// A block of TileSize x TileSize texels (tiles on the border may only be partially used)
+    struct Tile {
+        Color3f texels[TileSize * TileSize];
+
+        const Color3f &texel(int x, int y) const { return texels[y * TileSize + x]; }
+    };
+
+    /// Interface of objects that provide tiles to the cache
+    class TileProvider {
+    public:
+        virtual ~TileProvider() { }
+
+        /// Load the tile (x, y) of the given mip-map level
+        virtual std::shared_ptr<Tile> loadTile(int level, int x, int y) const = 0;
+    };
+
+    /// Return the global texture cache
+    static TextureCache *getInstance();
+
+    /// Register a texture and return the identifier used to look up its tiles
+    uint32_t registerProvider(const TileProvider *provider);
+
+    /// Unregister a texture and release all of its tiles
+    void unregisterProvider(uint32_t id);
+
+    /**
+     * \brief Look up a tile, loading it if it isn't resident
+     *
+     * The returned tile remains valid until the next lookup by the same thread.
+     */
+    const Tile *lookup(uint32_t id, int level, int x, int y);
+
+    /// Set the maximum amount of memory used by resident tiles (in bytes)
+    void setMemoryLimit(size_t limit) { m_memoryLimit = limit; }
+
+    /// Return the maximum amount of memory used by resident tiles (in bytes)
+    size_t getMemoryLimit() const { return m_memoryLimit; }
+
+    /// Return the number of tile lookups since the last call to \ref resetStatistics()
+    uint64_t getLookupCount() const;
+
+    /// Reset the hit/miss counters and the peak memory usage
+    void resetStatistics();
+
+    /// Return a summary of the cache statistics
+    std::string toString() const;
+private:
+    TextureCache();
+
+    static const int ShardCount = 16;
+
+    struct Entry {
+        uint64_t key;
+        std::shared_ptr<const Tile> tile;
+    };
+
+    /// Tile table and hit/miss counters of one thread
+    struct ThreadState;
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t memory = 0;
+    };
+
+    /// Return the state of the calling thread (allocated on first use)
+    ThreadState *getThreadState();
+
+    /// Look up a tile in the shards, loading it if it isn't resident
+    std::shared_ptr<const Tile> lookupShared(uint32_t id, int level, int x, int y,
+                                             ThreadState *state);
+
+    Shard m_shards[ShardCount];
+    std::mutex m_providerMutex;
+    std::unordered_map<uint32_t, const TileProvider *> m_providers;
+    uint32_t m_nextId = 0;
+    std::atomic<size_t> m_memoryLimit;
+    std::atomic<size_t> m_memory, m_peakMemory;
+
+    /// Incremented when a texture is unregistered (invalidates the tables of all threads)
+    std::atomic<uint32_t> m_epoch;
+    mutable std::mutex m_threadMutex;
+    std::vector<ThreadState *> m_threadStates;
+};
+
+NORI_NAMESPACE_END
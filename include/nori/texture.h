@@ -0,0 +1,70 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <nori/object.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Superclass of all textures
+ *
+ * Textures are declared as children of other objects (e.g. BSDFs) using
+ * the \c texture tag. Its \c name attribute specifies the parameter of
+ * the parent object that is replaced by the texture, e.g.
+ *
+ * \code
+ * <bsdf type="diffuse">
+ *     <texture type="bitmap" name="albedo">
+ *         <string name="filename" value="wood.exr"/>
+ *     </texture>
+ * </bsdf>
+ * \endcode
+ */
+class Texture : public NoriObject {
+public:
+    /**
+     * \brief Evaluate the texture at the given UV coordinates
+     *
+     * \param uv
+     *     Texture coordinates of the lookup
+     * \param width
+     *     Width of the filter footprint in UV space. Larger footprints
+     *     are served from coarser resolution levels of the texture
+     *     (zero: use the finest level)
+     */
+    virtual Color3f eval(const Point2f &uv, float width = 0.0f) const = 0;
+
+    /// Return the name of the parameter that this texture provides
+    const std::string &getName() const { return m_name; }
+
+    /// Set the name of the parameter that this texture provides
+    void setName(const std::string &name) { m_name = name; }
+
+    /**
+     * \brief Return the type of object (i.e. Mesh/BSDF/etc.)
+     * provided by this instance
+     * */
+    EClassType getClassType() const { return ETexture; }
+protected:
+    std::string m_name;
+};
+
+NORI_NAMESPACE_END
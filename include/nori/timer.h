@@ -24,9 +24,11 @@
 NORI_NAMESPACE_BEGIN
 
 /**
- * \brief Simple timer with millisecond precision
+ * \brief Simple timer that reports elapsed times in milliseconds
  *
- * This class is convenient for collecting performance data
+ * This class is convenient for collecting performance data. It uses a
+ * steady clock with sub-millisecond resolution, hence it is also suitable
+ * for timing short benchmark runs.
  */
 class Timer {
 public:
@@ -34,13 +36,13 @@ public:
     Timer() { reset(); }
 
     /// Reset the timer to the current time
-    void reset() { start = std::chrono::system_clock::now(); }
+    void reset() { start = std::chrono::steady_clock::now(); }
 
     /// Return the number of milliseconds elapsed since the timer was last reset
     double elapsed() const {
-        auto now = std::chrono::system_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-        return (double) duration.count();
+        auto now = std::chrono::steady_clock::now();
+        auto duration = std::chrono::duration<double, std::milli>(now - start);
+        return duration.count();
     }
 
     /// Like \ref elapsed(), but return a human-readable string
@@ -50,10 +52,10 @@ public:
 
     /// Return the number of milliseconds elapsed since the timer was last reset and then reset it
     double lap() {
-        auto now = std::chrono::system_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+        auto now = std::chrono::steady_clock::now();
+        auto duration = std::chrono::duration<double, std::milli>(now - start);
         start = now;
-        return (double) duration.count();
+        return duration.count();
     }
 
     /// Like \ref lap(), but return a human-readable string
@@ -61,7 +63,7 @@ public:
         return timeString(lap(), precise);
     }
 private:
-    std::chrono::system_clock::time_point start;
+    std::chrono::steady_clock::time_point start;
 };
 
 NORI_NAMESPACE_END
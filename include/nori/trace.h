@@ -0,0 +1,107 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <nori/common.h>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Timeline of scoped events that can be viewed in a trace viewer
+ *
+ * When tracing is enabled, every \ref TraceScope records its start time
+ * and duration into a ring buffer that belongs to the current thread (so
+ * that recording never waits for other threads). When a buffer is full,
+ * the oldest events of the thread are overwritten. The events of all
+ * threads are finally written in the Chrome trace event format, which
+ * can be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * When tracing is disabled, a \ref TraceScope only checks a flag.
+ */
+class Trace {
+public:
+    /// Start recording events (at most \c eventsPerThread per thread)
+    static void enable(size_t eventsPerThread = 1 << 16);
+
+    /// Is tracing currently enabled?
+    static bool isEnabled() { return m_enabled.load(std::memory_order_relaxed); }
+
+    /// Return the time in nanoseconds since tracing was enabled
+    static int64_t now();
+
+    /// Record an event of the calling thread
+    static void record(const char *category, const char *name, int64_t begin,
+                       int64_t end, int64_t index, const std::string &detail);
+
+    /**
+     * \brief Write all recorded events as a Chrome trace JSON file
+     *
+     * This function must not be called while other threads are
+     * recording events.
+     */
+    static void save(const std::string &filename);
+
+private:
+    static std::atomic<bool> m_enabled;
+};
+
+/**
+ * \brief Records an event that spans the lifetime of this object
+ *
+ * Events can optionally be annotated with an index (e.g. of an image
+ * block) or with a string (e.g. a filename).
+ */
+class TraceScope {
+public:
+    TraceScope(const char *category, const char *name, int64_t index = -1)
+        : m_category(category), m_name(name), m_index(index),
+          m_begin(Trace::isEnabled() ? Trace::now() : -1) { }
+
+    /// The string is only copied when tracing is enabled
+    TraceScope(const char *category, const char *name, const std::string &detail)
+        : m_category(category), m_name(name), m_index(-1),
+          m_begin(Trace::isEnabled() ? Trace::now() : -1) {
+        if (m_begin >= 0)
+            m_detail = detail;
+    }
+
+    ~TraceScope() {
+        if (m_begin >= 0)
+            Trace::record(m_category, m_name, m_begin, Trace::now(), m_index, m_detail);
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+private:
+    const char *m_category;
+    const char *m_name;
+    int64_t m_index;
+    std::string m_detail;
+    int64_t m_begin;
+};
+
+#define NORI_TRACE_CONCAT_(a, b) a ## b
+#define NORI_TRACE_CONCAT(a, b) NORI_TRACE_CONCAT_(a, b)
+
+/// Record an event that lasts until the end of the current scope
+#define NORI_TRACE_SCOPE(...) \
+    nori::TraceScope NORI_TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+
+NORI_NAMESPACE_END
@@ -67,6 +67,23 @@ public:
 
     /// Probability density of \ref squareToBeckmann()
     static float squareToBeckmannPdf(const Vector3f &m, float alpha);
+
+    /**
+     * \brief Warp a uniformly distributed square sample to the distribution
+     * of Beckmann microfacet normals that are visible from direction 'wi'
+     *
+     * This is the distribution D(m) G1(wi, m) <wi, m> / cos(theta_i) proposed
+     * by Heitz and d'Eon ("Importance Sampling Microfacet-Based BSDFs using
+     * the Distribution of Visible Normals", EGSR 2014). Backfacing and masked
+     * microfacets are never generated.
+     */
+    static Vector3f squareToBeckmannVisible(const Point2f &sample, const Vector3f &wi, float alpha);
+
+    /// Probability density of \ref squareToBeckmannVisible()
+    static float squareToBeckmannVisiblePdf(const Vector3f &m, const Vector3f &wi, float alpha);
+
+    /// Exact Smith shadowing-masking term of the Beckmann distribution for direction 'v'
+    static float beckmannSmithG1(const Vector3f &v, float alpha);
 };
 
 NORI_NAMESPACE_END
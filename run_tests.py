@@ -1,28 +1,55 @@
 from __future__ import print_function
+import argparse
+import multiprocessing
 import subprocess
 import sys
+import time
+from multiprocessing.pool import ThreadPool
 
 tests = [
     "pa4/tests/test-mesh.xml",
     "pa4/tests/test-mesh-furnace.xml",
     "pa5/tests/chi2test-microfacet.xml",
     "pa5/tests/ttest-microfacet.xml",
+    "pa5/tests/chi2test-microfacet-visible.xml",
+    "pa5/tests/ttest-microfacet-visible.xml",
     "pa5/tests/test-direct.xml",
     "pa5/tests/test-furnace.xml",
 ]
 
+parser = argparse.ArgumentParser(description="Run the statistical test suite")
+parser.add_argument("-j", "--jobs", type=int, default=multiprocessing.cpu_count(),
+                    help="number of tests that run concurrently")
+parser.add_argument("-v", "--verbose", action="store_true",
+                    help="print the output of all tests (not only of failed ones)")
+args = parser.parse_args()
+
 total = len(tests)
 passed = 0
 
 failed = []
 
-for t in tests:
-    path = "scenes/" + t
-    ret = subprocess.call(["./build/nori", path])
+
+def run(t):
+    # The output is captured so that concurrent tests do not interleave
+    start = time.time()
+    process = subprocess.Popen(["./build/nori", "scenes/" + t],
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = process.communicate()[0].decode("utf-8", "replace")
+    return process.returncode, output, time.time() - start
+
+
+pool = ThreadPool(max(1, min(args.jobs, total)))
+for t, (ret, output, seconds) in zip(tests, pool.imap(run, tests)):
+    if args.verbose or ret != 0:
+        print(output)
     if ret == 0:
         passed += 1
+        print("\033[92m" + "PASS" + "\033[0m " + t + " (%.1f s)" % seconds)
     else:
         failed.append(t)
+        print("\033[91m" + "FAIL" + "\033[0m " + t + " (%.1f s)" % seconds)
+pool.close()
 
 print("")
 if passed < total:
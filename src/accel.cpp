@@ -18,6 +18,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <nori/accel.h>
 #include <nori/timer.h>
+#include <nori/stats.h>
+#include <nori/trace.h>
 #include <tbb/tbb.h>
 #include <Eigen/Geometry>
 #include <atomic>
@@ -334,46 +336,63 @@ void Accel::build() {
 		<< (m_meshes.size() == 1 ? " mesh, " : " meshes, ")
 		<< size << " triangles) .. ";
 	cout.flush();
+	NORI_TRACE_SCOPE("accel", "BVH build");
 	Timer timer;
 
-	/* Conservative estimate for the total number of nodes */
-	m_nodes.resize(2 * size);
-	memset(m_nodes.data(), 0, sizeof(BVHNode) * m_nodes.size());
-	m_nodes[0].bbox = m_bbox;
-	m_indices.resize(size);
-
 	if (sizeof(BVHNode) != 32)
 		throw NoriException("BVH Node is not packed! Investigate compiler settings.");
 
-	for (uint32_t i = 0; i < size; ++i)
-		m_indices[i] = i;
+	{
+		NORI_TRACE_SCOPE("accel", "BVH allocate");
+
+		/* Conservative estimate for the total number of nodes */
+		m_nodes.resize(2 * size);
+		memset(m_nodes.data(), 0, sizeof(BVHNode) * m_nodes.size());
+		m_nodes[0].bbox = m_bbox;
+		m_indices.resize(size);
+
+		for (uint32_t i = 0; i < size; ++i)
+			m_indices[i] = i;
+	}
 
-	uint32_t *indices = m_indices.data(), *temp = new uint32_t[size];
-	BVHBuildTask& task = *new(tbb::task::allocate_root())
-		BVHBuildTask(*this, 0u, indices, indices + size, temp);
-	tbb::task::spawn_root_and_wait(task);
-	delete[] temp;
-	std::pair<float, uint32_t> stats = statistics();
+	{
+		NORI_TRACE_SCOPE("accel", "BVH construct");
+		uint32_t *indices = m_indices.data(), *temp = new uint32_t[size];
+		BVHBuildTask& task = *new(tbb::task::allocate_root())
+			BVHBuildTask(*this, 0u, indices, indices + size, temp);
+		tbb::task::spawn_root_and_wait(task);
+		delete[] temp;
+	}
+
+	std::pair<float, uint32_t> stats;
+	{
+		NORI_TRACE_SCOPE("accel", "BVH statistics");
+		stats = statistics();
+	}
 
 	/* The node array was allocated conservatively and now contains
 	many unused entries -- do a compactification pass. */
 	std::vector<BVHNode> compactified(stats.second);
-	std::vector<uint32_t> skipped_accum(m_nodes.size());
-
-	for (int64_t i = stats.second - 1, j = m_nodes.size(), skipped = 0; i >= 0; --i) {
-		while (m_nodes[--j].isUnused())
-			skipped++;
-		BVHNode &new_node = compactified[i];
-		new_node = m_nodes[j];
-		skipped_accum[j] = (uint32_t)skipped;
-
-		if (new_node.isInner()) {
-			new_node.inner.rightChild = (uint32_t)
-				(i + new_node.inner.rightChild - j -
-				(skipped - skipped_accum[new_node.inner.rightChild]));
+	{
+		NORI_TRACE_SCOPE("accel", "BVH compactify");
+		std::vector<uint32_t> skipped_accum(m_nodes.size());
+
+		for (int64_t i = stats.second - 1, j = m_nodes.size(), skipped = 0; i >= 0; --i) {
+			while (m_nodes[--j].isUnused())
+				skipped++;
+			BVHNode &new_node = compactified[i];
+			new_node = m_nodes[j];
+			skipped_accum[j] = (uint32_t)skipped;
+
+			if (new_node.isInner()) {
+				new_node.inner.rightChild = (uint32_t)
+					(i + new_node.inner.rightChild - j -
+					(skipped - skipped_accum[new_node.inner.rightChild]));
+			}
 		}
 	}
-	cout << "done (took " << timer.elapsedString() << " and "
+	m_buildTime = timer.elapsed();
+	cout << "done (took " << timeString(m_buildTime) << " and "
 		<< memString(sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t)*m_indices.size())
 		<< ", SAH cost = " << stats.first
 		<< ")." << endl;
@@ -402,10 +421,10 @@ std::pair<float, uint32_t> Accel::statistics(uint32_t node_idx) const {
 	}
 }
 
-bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) const {
+template <bool ShadowRay> bool Accel::traverse(const Ray3f &_ray, HitRecord &hit) const {
 	uint32_t node_idx = 0, stack_idx = 0, stack[64];
 
-	its.t = std::numeric_limits<float>::infinity();
+	hit.t = std::numeric_limits<float>::infinity();
 
 	/* Use an adaptive ray epsilon */
 	Ray3f ray(_ray);
@@ -416,7 +435,6 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
 		return false;
 
 	bool foundIntersection = false;
-	uint32_t f = 0;
 
 	while (true) {
 		const BVHNode &node = m_nodes[node_idx];
@@ -440,13 +458,13 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
 
 				float u, v, t;
 				if (mesh->rayIntersect(idx, ray, u, v, t)) {
-					if (shadowRay)
+					if (ShadowRay)
 						return true;
 					foundIntersection = true;
-					ray.maxt = its.t = t;
-					its.uv = Point2f(u, v);
-					its.mesh = mesh;
-					f = idx;
+					ray.maxt = hit.t = t;
+					hit.bary = Point2f(u, v);
+					hit.mesh = mesh;
+					hit.triangle = idx;
 				}
 			}
 			if (stack_idx == 0)
@@ -456,54 +474,50 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
 		}
 	}
 
-	if (foundIntersection) {
-		/* Find the barycentric coordinates */
-		Vector3f bary;
-		bary << 1 - its.uv.sum(), its.uv;
-
-		/* References to all relevant mesh buffers */
-		const Mesh *mesh = its.mesh;
-		const MatrixXf &V = mesh->getVertexPositions();
-		const MatrixXf &N = mesh->getVertexNormals();
-		const MatrixXf &UV = mesh->getVertexTexCoords();
-		const MatrixXu &F = mesh->getIndices();
-
-		/* Vertex indices of the triangle */
-		uint32_t idx0 = F(0, f), idx1 = F(1, f), idx2 = F(2, f);
-
-		Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
-
-		/* Compute the intersection positon accurately
-		using barycentric coordinates */
-		its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
-
-		/* Compute proper texture coordinates if provided by the mesh */
-		if (UV.size() > 0)
-			its.uv = bary.x() * UV.col(idx0),
-			bary.y() * UV.col(idx1),
-			bary.z() * UV.col(idx2);
-
-		/* Compute the geometry frame */
-		its.geoFrame = Frame((p1 - p0).cross(p2 - p0).normalized());
-
-		if (N.size() > 0) {
-			/* Compute the shading frame. Note that for simplicity,
-			the current implementation doesn't attempt to provide
-			tangents that are continuous across the surface. That
-			means that this code will need to be modified to be able
-			use anisotropic BRDFs, which need tangent continuity */
-
-			its.shFrame = Frame(
-				(bary.x() * N.col(idx0) +
-					bary.y() * N.col(idx1) +
-					bary.z() * N.col(idx2)).normalized());
-		}
-		else {
-			its.shFrame = its.geoFrame;
-		}
+	return foundIntersection;
+}
+
+NORI_STAT_COUNTER(statClosestHitRays, "Rays", "Closest-hit rays");
+NORI_STAT_COUNTER(statFullIntersections, "Rays", "Closest-hit rays (full intersection)");
+NORI_STAT_RATIO(statOccludedShadowRays, "Rays", "Occluded shadow rays");
+
+/// Number of rays traced by the current thread (always counted, unlike the statistics)
+static thread_local uint64_t threadRayCount = 0;
+
+uint64_t Accel::getThreadRayCount() {
+	return threadRayCount;
+}
+
+bool Accel::rayIntersect(const Ray3f &ray, HitRecord &hit) const {
+	threadRayCount++;
+	NORI_STAT_ADD(statClosestHitRays, 1);
+	return traverse<false>(ray, hit);
+}
+
+bool Accel::rayIntersect(const Ray3f &ray) const {
+	threadRayCount++;
+	HitRecord hit; /* Unused */
+	bool occluded = traverse<true>(ray, hit);
+	NORI_STAT_RATIO_ADD(statOccludedShadowRays, occluded ? 1 : 0, 1);
+	return occluded;
+}
+
+bool Accel::rayIntersect(const Ray3f &ray, Intersection &its, bool shadowRay) const {
+	if (shadowRay)
+		return rayIntersect(ray);
+
+	threadRayCount++;
+	NORI_STAT_ADD(statClosestHitRays, 1);
+	NORI_STAT_ADD(statFullIntersections, 1);
+	HitRecord hit;
+	if (!traverse<false>(ray, hit)) {
+		its.t = hit.t;
+		return false;
 	}
 
-	return foundIntersection;
+	hit.computeIntersection(its);
+	its.uvWidth = hit.computeUVWidth(ray, its);
+	return true;
 }
 
 NORI_NAMESPACE_END
@@ -2,7 +2,7 @@
 #include <nori/scene.h>
 #include <nori/warp.h>
 #include <pcg32.h>
-#include <Eigen/src/Geometry/Transform.h>
+#include <Eigen/Geometry>
 
 NORI_NAMESPACE_BEGIN
 
@@ -30,14 +30,17 @@ public:
 		Frame axis(normal);
 		Point3f x = its.p;
 		
-		int n = 200;
+		const int n = 200;
 		
+		/* Draw the samples of all directions in a single call */
+		Point2f samples[n];
+		sampler->next2DArray(samples, n);
 
 		float result=0.f;
 		
 		for (int i = 0; i <n ; ++i)
 		{
-			Point3f hemi = Warp::squareToCosineHemisphere(Point2f(sampler->next2D()));
+			Point3f hemi = Warp::squareToCosineHemisphere(samples[i]);
 
 
 			Point3f p = axis.toWorld(hemi)+x;
@@ -50,7 +53,7 @@ public:
 			
 			Ray3f _ray(x, w);
 
-			if (!scene->rayIntersect(_ray, its))
+			if (!scene->rayIntersect(_ray))
 				result += INV_PI * normal.dot(w) / w.norm();
 
 			
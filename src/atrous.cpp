@@ -0,0 +1,191 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/denoiser.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Edge-avoiding a-trous wavelet filter
+ *
+ * Implements the edge-avoiding a-trous filter by Dammertz et al. ("Edge-
+ * Avoiding A-Trous Wavelet Transform for fast Global Illumination
+ * Filtering", HPG 2010). Each iteration convolves the image with a 5x5
+ * B3-spline kernel whose taps are spaced 2^i pixels apart, so that large
+ * footprints are reached with few taps. The contribution of every tap is
+ * attenuated when its color, albedo, normal or depth differ from those of
+ * the center pixel, which preserves geometric and texture edges.
+ *
+ * By default, the image is first divided by the albedo buffer so that the
+ * filter only smooths the (mostly low-frequency) illumination; texture
+ * detail is restored by multiplying with the albedo afterwards.
+ */
+class ATrousDenoiser : public Denoiser {
+public:
+    ATrousDenoiser(const PropertyList &propList) {
+        /* Number of filter passes (the footprint doubles with every pass) */
+        m_iterations = propList.getInteger("iterations", 5);
+
+        /* Edge-stopping parameters (larger values: more blurring) */
+        m_sigmaColor = propList.getFloat("sigmaColor", 0.5f);
+        m_sigmaNormal = propList.getFloat("sigmaNormal", 0.1f);
+        m_sigmaAlbedo = propList.getFloat("sigmaAlbedo", 0.1f);
+
+        /* Depth tolerance, relative to the depth of the center pixel */
+        m_sigmaDepth = propList.getFloat("sigmaDepth", 0.05f);
+
+        /* Filter the illumination only, i.e. divide out the albedo? */
+        m_demodulate = propList.getBoolean("demodulate", true);
+
+        if (m_iterations < 1)
+            throw NoriException("ATrousDenoiser: at least one iteration is required!");
+        if (m_sigmaColor <= 0 || m_sigmaNormal <= 0 || m_sigmaAlbedo <= 0 || m_sigmaDepth <= 0)
+            throw NoriException("ATrousDenoiser: the edge-stopping parameters must be positive!");
+    }
+
+    void denoise(Bitmap &image, const Bitmap &albedo,
+                 const Bitmap &normal, const Bitmap &depth) const {
+        const ptrdiff_t rows = image.rows(), cols = image.cols();
+        if (albedo.rows() != rows || albedo.cols() != cols ||
+            normal.rows() != rows || normal.cols() != cols ||
+            depth.rows() != rows || depth.cols() != cols)
+            throw NoriException("ATrousDenoiser: the feature buffers must match the image size!");
+
+        if (m_demodulate)
+            transform(image, albedo, false);
+
+        /* B3-spline weights of the separable 5-tap kernel */
+        const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+        Bitmap temp(Vector2i(cols, rows));
+        Bitmap *src = &image, *dst = &temp;
+
+        for (int iteration = 0; iteration < m_iterations; ++iteration) {
+            int step = 1 << iteration;
+
+            /* The image gets smoother with every pass, hence the color
+               criterion becomes stricter (Dammertz et al., Section 4) */
+            float invColor = 1.0f / (m_sigmaColor * m_sigmaColor * std::pow(0.25f, (float) iteration));
+            float invNormal = 1.0f / (m_sigmaNormal * m_sigmaNormal);
+            float invAlbedo = 1.0f / (m_sigmaAlbedo * m_sigmaAlbedo);
+            float invDepth = 1.0f / (m_sigmaDepth * m_sigmaDepth);
+
+            tbb::parallel_for(tbb::blocked_range<ptrdiff_t>(0, rows),
+                [&](const tbb::blocked_range<ptrdiff_t> &range) {
+                for (ptrdiff_t y = range.begin(); y != range.end(); ++y) {
+                    for (ptrdiff_t x = 0; x < cols; ++x) {
+                        const Color3f c0 = tonemap(src->coeff(y, x));
+                        const Color3f &a0 = albedo.coeff(y, x);
+                        const Color3f &n0 = normal.coeff(y, x);
+                        const float d0 = depth.coeff(y, x).r();
+
+                        Color3f sum(0.0f);
+                        float weightSum = 0.0f;
+
+                        for (int i = 0; i < 5; ++i) {
+                            ptrdiff_t yi = y + (i - 2) * step;
+                            if (yi < 0 || yi >= rows)
+                                continue;
+                            for (int j = 0; j < 5; ++j) {
+                                ptrdiff_t xj = x + (j - 2) * step;
+                                if (xj < 0 || xj >= cols)
+                                    continue;
+
+                                const Color3f &c = src->coeff(yi, xj);
+                                float dColor = (tonemap(c) - c0).matrix().squaredNorm();
+                                float dAlbedo = (albedo.coeff(yi, xj) - a0).matrix().squaredNorm();
+                                float dNormal = (normal.coeff(yi, xj) - n0).matrix().squaredNorm();
+                                float dDepth = depth.coeff(yi, xj).r() - d0;
+                                dDepth = dDepth * dDepth / std::max(d0 * d0, Epsilon);
+
+                                float weight = kernel[i] * kernel[j] * std::exp(
+                                    -dColor * invColor - dAlbedo * invAlbedo
+                                    -dNormal * invNormal - dDepth * invDepth);
+
+                                sum += c * weight;
+                                weightSum += weight;
+                            }
+                        }
+
+                        /* The center tap always has a positive weight */
+                        dst->coeffRef(y, x) = sum / weightSum;
+                    }
+                }
+            });
+
+            std::swap(src, dst);
+        }
+
+        if (src != &image)
+            image = *src;
+
+        if (m_demodulate)
+            transform(image, albedo, true);
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "ATrousDenoiser[\n"
+            "  iterations = %i,\n"
+            "  sigmaColor = %f,\n"
+            "  sigmaNormal = %f,\n"
+            "  sigmaAlbedo = %f,\n"
+            "  sigmaDepth = %f,\n"
+            "  demodulate = %s\n"
+            "]",
+            m_iterations, m_sigmaColor, m_sigmaNormal, m_sigmaAlbedo,
+            m_sigmaDepth, m_demodulate ? "true" : "false");
+    }
+
+protected:
+    /// Compress the dynamic range so that fireflies do not dominate the color distance
+    static Color3f tonemap(const Color3f &c) {
+        return c / (Color3f(1.0f) + c.cwiseMax(0.0f));
+    }
+
+    /// Divide the image by the albedo (or multiply it back in)
+    static void transform(Bitmap &image, const Bitmap &albedo, bool remodulate) {
+        tbb::parallel_for(tbb::blocked_range<ptrdiff_t>(0, image.rows()),
+            [&](const tbb::blocked_range<ptrdiff_t> &range) {
+            for (ptrdiff_t y = range.begin(); y != range.end(); ++y) {
+                for (ptrdiff_t x = 0; x < image.cols(); ++x) {
+                    Color3f &c = image.coeffRef(y, x);
+                    const Color3f &a = albedo.coeff(y, x);
+                    for (int k = 0; k < 3; ++k) {
+                        /* Leave black (or nearly black) surfaces alone */
+                        if (a[k] > 1e-3f)
+                            c[k] = remodulate ? c[k] * a[k] : c[k] / a[k];
+                    }
+                }
+            }
+        });
+    }
+
+    int m_iterations;
+    float m_sigmaColor;
+    float m_sigmaNormal;
+    float m_sigmaAlbedo;
+    float m_sigmaDepth;
+    bool m_demodulate;
+};
+
+NORI_REGISTER_CLASS(ATrousDenoiser, "atrous");
+NORI_NAMESPACE_END
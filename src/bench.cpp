@@ -0,0 +1,341 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/parser.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/warp.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/task_scheduler_init.h>
+#include <pcg32.h>
+#include <fstream>
+#include <memory>
+
+/* Scene-level ray tracing benchmark
+
+   Loads a set of scenes and measures the throughput of the acceleration
+   data structure for three kinds of rays:
+
+   - primary rays, which are spawned by the camera and are traced to
+     the closest intersection (including the full intersection record),
+   - diffuse bounces, i.e. incoherent rays that are sampled from a cosine-
+     weighted distribution at the primary intersections,
+   - shadow rays, which connect the primary intersections to points on
+     the emitters (or on the bounding box, if the scene has no emitters)
+     and only check for occlusion.
+
+   All rays are generated before the measurement, hence only the cost of
+   the intersection queries is reported. The results are printed and can
+   also be written to a JSON file to compare different builds. */
+
+NORI_NAMESPACE_BEGIN
+
+/// Scenes that are benchmarked by default (relative to the Nori root directory)
+static const char *defaultScenes[] = {
+    "scenes/pa1/bunny.xml",
+    "scenes/pa2/ajax-normals.xml",
+    "scenes/pa3/ajax-ao.xml",
+    "scenes/pa4/cbox/cbox-distributed.xml",
+    "scenes/pa4/motto/motto-diffuse.xml",
+    "scenes/pa5/ajax/ajax-rough.xml",
+    "scenes/pa5/cbox/cbox_mis.xml",
+    "scenes/pa5/table/table_mis.xml",
+    "scenes/pa5/veach_mi/veach_mis.xml"
+};
+
+/// Throughput measurement for one kind of ray
+struct RayStatistics {
+    size_t rays = 0;
+    size_t hits = 0;
+    double time = 0; ///< Milliseconds
+
+    double mraysPerSecond() const {
+        return time > 0 ? rays / (time * 1000.0) : 0.0;
+    }
+};
+
+/// Benchmark results for one scene
+struct SceneStatistics {
+    std::string filename;
+    std::string error;
+    uint32_t meshCount = 0;
+    uint32_t triangleCount = 0;
+    double loadTime = 0;  ///< Milliseconds (including the BVH build)
+    double buildTime = 0; ///< Milliseconds
+    size_t peakMemory = 0;
+    RayStatistics primary, diffuse, shadow;
+};
+
+/// Trace a set of rays in parallel and measure the elapsed time
+template <typename Func> static void traceRays(size_t count, RayStatistics &stats, const Func &func) {
+    std::vector<uint8_t> hit(count);
+    Timer timer;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, count, 1024),
+        [&](const tbb::blocked_range<size_t> &range) {
+            for (size_t i = range.begin(); i != range.end(); ++i)
+                hit[i] = func(i) ? 1 : 0;
+        }
+    );
+    stats.time = timer.elapsed();
+    stats.rays = count;
+    stats.hits = 0;
+    for (uint8_t h : hit)
+        stats.hits += h;
+}
+
+static void benchmarkScene(const Scene *scene, size_t rayCount, SceneStatistics &stats) {
+    const Camera *camera = scene->getCamera();
+    Vector2i size = camera->getOutputSize();
+    pcg32 rng;
+
+    /* Camera rays through uniformly distributed film positions */
+    std::vector<Ray3f> rays(rayCount);
+    for (size_t i = 0; i < rayCount; ++i) {
+        Point2f samplePosition(rng.nextFloat() * size.x(), rng.nextFloat() * size.y());
+        Point2f apertureSample(rng.nextFloat(), rng.nextFloat());
+        camera->sampleRay(rays[i], samplePosition, apertureSample);
+    }
+
+    std::vector<Intersection> its(rayCount);
+    traceRays(rayCount, stats.primary, [&](size_t i) {
+        return scene->rayIntersect(rays[i], its[i]);
+    });
+
+    /* Later rays start at the primary intersections */
+    std::vector<uint32_t> origins;
+    origins.reserve(stats.primary.hits);
+    for (size_t i = 0; i < rayCount; ++i) {
+        if (its[i].mesh)
+            origins.push_back((uint32_t) i);
+    }
+    if (origins.empty())
+        return;
+
+    /* Cosine-weighted bounces on the side of the incident ray */
+    std::vector<Ray3f> secondary(rayCount);
+    for (size_t i = 0; i < rayCount; ++i) {
+        const Intersection &origin = its[origins[i % origins.size()]];
+        const Ray3f &incident = rays[origins[i % origins.size()]];
+        Vector3f d = Warp::squareToCosineHemisphere(Point2f(rng.nextFloat(), rng.nextFloat()));
+        if (origin.shFrame.n.dot(incident.d) > 0)
+            d.z() = -d.z();
+        secondary[i] = Ray3f(origin.p, origin.shFrame.toWorld(d));
+    }
+
+    traceRays(rayCount, stats.diffuse, [&](size_t i) {
+        HitRecord hit;
+        return scene->rayIntersect(secondary[i], hit);
+    });
+
+    /* Shadow rays towards points on the emitters */
+    const BoundingBox3f &bbox = scene->getBoundingBox();
+    for (size_t i = 0; i < rayCount; ++i) {
+        const Intersection &origin = its[origins[i % origins.size()]];
+        Point3f target;
+        if (!scene->m_lights.empty()) {
+            const Mesh *light = scene->m_lights[rng.nextUInt((uint32_t) scene->m_lights.size())];
+            Normal3f n;
+            float pdf;
+            Point2f sample(rng.nextFloat(), rng.nextFloat());
+            light->sample(target, n, pdf, sample, rng.nextFloat());
+        } else {
+            for (int j = 0; j < 3; ++j)
+                target[j] = lerp(rng.nextFloat(), bbox.min[j], bbox.max[j]);
+        }
+        secondary[i] = Ray3f(origin.p, target - origin.p, Epsilon, 1 - Epsilon);
+    }
+
+    traceRays(rayCount, stats.shadow, [&](size_t i) {
+        return scene->rayIntersect(secondary[i]);
+    });
+}
+
+static void printStatistics(const SceneStatistics &stats) {
+    if (!stats.error.empty()) {
+        cout << "  failed: " << stats.error << endl;
+        return;
+    }
+    cout << "  " << stats.triangleCount << " triangles, loaded in "
+         << timeString(stats.loadTime, true) << " (BVH build: "
+         << timeString(stats.buildTime, true) << "), peak memory "
+         << memString(stats.peakMemory) << endl;
+
+    auto print = [](const char *name, const RayStatistics &rays) {
+        cout << tfm::format("  %-8s %8.2f Mrays/s (%zu rays, %.1f%% hit)", name,
+            rays.mraysPerSecond(), rays.rays,
+            rays.rays > 0 ? 100.0 * rays.hits / rays.rays : 0.0) << endl;
+    };
+    print("primary", stats.primary);
+    print("diffuse", stats.diffuse);
+    print("shadow", stats.shadow);
+}
+
+/// Escape a string so that it can be embedded in a JSON document
+static std::string jsonString(const std::string &value) {
+    std::string result = "\"";
+    for (char c : value) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if ((unsigned char) c < 0x20)
+                    result += tfm::format("\\u%04x", (int) c);
+                else
+                    result += c;
+        }
+    }
+    return result + "\"";
+}
+
+static void writeJSON(const std::string &filename, int threadCount, size_t rayCount,
+                      const std::vector<SceneStatistics> &results) {
+    std::ofstream os(filename);
+    if (!os)
+        throw NoriException("Unable to write \"%s\"", filename);
+
+    auto rayStats = [](const RayStatistics &rays) {
+        return tfm::format("{ \"rays\": %zu, \"hits\": %zu, \"seconds\": %.6f, \"mraysPerSecond\": %.4f }",
+            rays.rays, rays.hits, rays.time / 1000.0, rays.mraysPerSecond());
+    };
+
+    os << "{" << endl
+       << "  \"threads\": " << threadCount << "," << endl
+       << "  \"raysPerType\": " << rayCount << "," << endl
+       << "  \"scenes\": [" << endl;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const SceneStatistics &stats = results[i];
+        os << "    {" << endl
+           << "      \"scene\": " << jsonString(stats.filename) << "," << endl;
+        if (!stats.error.empty()) {
+            os << "      \"error\": " << jsonString(stats.error) << endl;
+        } else {
+            os << "      \"meshes\": " << stats.meshCount << "," << endl
+               << "      \"triangles\": " << stats.triangleCount << "," << endl
+               << tfm::format("      \"loadSeconds\": %.6f,", stats.loadTime / 1000.0) << endl
+               << tfm::format("      \"bvhBuildSeconds\": %.6f,", stats.buildTime / 1000.0) << endl
+               << "      \"peakMemoryBytes\": " << stats.peakMemory << "," << endl
+               << "      \"primary\": " << rayStats(stats.primary) << "," << endl
+               << "      \"diffuse\": " << rayStats(stats.diffuse) << "," << endl
+               << "      \"shadow\": " << rayStats(stats.shadow) << endl;
+        }
+        os << "    }" << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    os << "  ]" << endl
+       << "}" << endl;
+}
+
+NORI_NAMESPACE_END
+
+int main(int argc, char **argv) {
+    using namespace nori;
+
+    std::vector<std::string> scenes;
+    std::string outputName;
+    size_t rayCount = 1 << 20;
+    int threadCount = tbb::task_scheduler_init::automatic;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "--rays" && i + 1 < argc) {
+                rayCount = (size_t) toUInt(argv[++i]);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threadCount = toInt(argv[++i]);
+            } else if (arg == "--output" && i + 1 < argc) {
+                outputName = argv[++i];
+            } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+                cerr << "Syntax: " << argv[0] << " [--rays N] [--threads N] "
+                        "[--output results.json] [scene.xml ...]" << endl;
+                return -1;
+            } else {
+                scenes.push_back(arg);
+            }
+        }
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return -1;
+    }
+
+    if (scenes.empty())
+        scenes.assign(std::begin(defaultScenes), std::end(defaultScenes));
+    if (rayCount == 0) {
+        cerr << "Fatal error: the number of rays must be positive" << endl;
+        return -1;
+    }
+
+    tbb::task_scheduler_init init(threadCount);
+    if (threadCount == tbb::task_scheduler_init::automatic)
+        threadCount = tbb::task_scheduler_init::default_num_threads();
+
+    std::vector<SceneStatistics> results;
+    bool failed = false;
+
+    for (const std::string &sceneName : scenes) {
+        SceneStatistics stats;
+        stats.filename = sceneName;
+        cout << "Benchmarking \"" << sceneName << "\" .." << endl;
+
+        /* Resolve the scene's resources relative to its directory */
+        filesystem::resolver *resolver = getFileResolver();
+        resolver->prepend(filesystem::path(sceneName).parent_path());
+
+        try {
+            Timer timer;
+            std::unique_ptr<NoriObject> root(loadFromXML(sceneName));
+            stats.loadTime = timer.elapsed();
+
+            if (root->getClassType() != NoriObject::EScene)
+                throw NoriException("\"%s\" does not describe a scene", sceneName);
+            const Scene *scene = static_cast<const Scene *>(root.get());
+            const Accel *accel = scene->getAccel();
+            stats.meshCount = accel->getMeshCount();
+            stats.triangleCount = accel->getTriangleCount();
+            stats.buildTime = accel->getBuildTime();
+
+            /* Measured before the rays are allocated. Note that this is
+               the peak of the entire process, i.e. of all scenes so far */
+            stats.peakMemory = getPeakMemoryUsage();
+
+            benchmarkScene(scene, rayCount, stats);
+        } catch (const std::exception &e) {
+            stats.error = e.what();
+            failed = true;
+        }
+
+        resolver->erase(resolver->begin());
+        printStatistics(stats);
+        results.push_back(stats);
+    }
+
+    if (!outputName.empty()) {
+        try {
+            writeJSON(outputName, threadCount, rayCount, results);
+            cout << "Wrote results to \"" << outputName << "\"" << endl;
+        } catch (const std::exception &e) {
+            cerr << "Fatal error: " << e.what() << endl;
+            return -1;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
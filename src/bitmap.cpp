@@ -17,6 +17,7 @@
 */
 
 #include <nori/bitmap.h>
+#include <nori/trace.h>
 #include <ImfInputFile.h>
 #include <ImfOutputFile.h>
 #include <ImfChannelList.h>
@@ -49,14 +50,16 @@ Bitmap::Bitmap(const std::string &filename) {
             continue;
         }
 
-        if (!ch_r && (name == "r" || name == "red" ||
-                endsWith(name, ".r") || endsWith(name, ".red"))) {
+        /* Channels without a layer prefix take precedence over those of
+           additional layers (e.g. AOVs written by Nori) */
+        if (name == "r" || name == "red" ||
+                (!ch_r && (endsWith(name, ".r") || endsWith(name, ".red")))) {
             ch_r = it.name();
-        } else if (!ch_g && (name == "g" || name == "green" ||
-                endsWith(name, ".g") || endsWith(name, ".green"))) {
+        } else if (name == "g" || name == "green" ||
+                (!ch_g && (endsWith(name, ".g") || endsWith(name, ".green")))) {
             ch_g = it.name();
-        } else if (!ch_b && (name == "b" || name == "blue" ||
-                endsWith(name, ".b") || endsWith(name, ".blue"))) {
+        } else if (name == "b" || name == "blue" ||
+                (!ch_b && (endsWith(name, ".b") || endsWith(name, ".blue")))) {
             ch_b = it.name();
         }
     }
@@ -79,8 +82,17 @@ Bitmap::Bitmap(const std::string &filename) {
 }
 
 void Bitmap::saveEXR(const std::string &filename) {
+    saveEXR(filename, std::vector<std::pair<std::string, const Bitmap *>>());
+}
+
+void Bitmap::saveEXR(const std::string &filename,
+                     const std::vector<std::pair<std::string, const Bitmap *>> &layers) {
+    NORI_TRACE_SCOPE("output", "Write OpenEXR", filename);
     cout << "Writing a " << cols() << "x" << rows()
-         << " OpenEXR file to \"" << filename << "\"" << endl;
+         << " OpenEXR file to \"" << filename << "\"";
+    if (!layers.empty())
+        cout << " (" << layers.size() << " additional layers)";
+    cout << endl;
 
     std::string path = filename + ".exr";
 
@@ -88,19 +100,28 @@ void Bitmap::saveEXR(const std::string &filename) {
     header.insert("comments", Imf::StringAttribute("Generated by Nori"));
 
     Imf::ChannelList &channels = header.channels();
-    channels.insert("R", Imf::Channel(Imf::FLOAT));
-    channels.insert("G", Imf::Channel(Imf::FLOAT));
-    channels.insert("B", Imf::Channel(Imf::FLOAT));
-
     Imf::FrameBuffer frameBuffer;
     size_t compStride = sizeof(float),
            pixelStride = 3 * compStride,
            rowStride = pixelStride * cols();
 
-    char *ptr = reinterpret_cast<char *>(data());
-    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+    auto insert = [&](const std::string &prefix, const Bitmap *bitmap) {
+        if (bitmap->cols() != cols() || bitmap->rows() != rows())
+            throw NoriException("Bitmap::saveEXR(): layer \"%s\" has an incompatible size!", prefix);
+
+        /* OpenEXR only reads from the frame buffer when writing a file */
+        char *ptr = reinterpret_cast<char *>(const_cast<Bitmap *>(bitmap)->data());
+        for (const char *channel : { "R", "G", "B" }) {
+            std::string name = prefix.empty() ? channel : prefix + "." + channel;
+            channels.insert(name.c_str(), Imf::Channel(Imf::FLOAT));
+            frameBuffer.insert(name.c_str(), Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+            ptr += compStride;
+        }
+    };
+
+    insert("", this);
+    for (const auto &layer : layers)
+        insert(layer.first, layer.second);
 
     Imf::OutputFile file(path.c_str(), header);
     file.setFrameBuffer(frameBuffer);
@@ -108,6 +129,7 @@ void Bitmap::saveEXR(const std::string &filename) {
 }
 
 void Bitmap::savePNG(const std::string &filename) {
+    NORI_TRACE_SCOPE("output", "Write PNG", filename);
     cout << "Writing a " << cols() << "x" << rows()
          << " PNG file to \"" << filename << "\"" << endl;
 
@@ -0,0 +1,366 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/texture.h>
+#include <nori/texcache.h>
+#include <nori/bitmap.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <ImfTiledRgbaFile.h>
+#include <ImfTestFile.h>
+#include <cstdio>
+
+#if defined(PLATFORM_WINDOWS)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Reduce the number of columns of an image using a box filter
+ *
+ * Every target texel averages the source texels that it overlaps (weighted
+ * by the overlap), so that the mean value is preserved even when the source
+ * resolution is not divisible by two.
+ */
+static Bitmap::Base downsample(const Bitmap::Base &source, int width) {
+    Bitmap::Base result(source.rows(), width);
+    float scale = source.cols() / (float) width;
+
+    for (int x=0; x<width; ++x) {
+        float start = x * scale, end = (x + 1) * scale;
+        for (ptrdiff_t y=0; y<source.rows(); ++y) {
+            Color3f sum(0.0f);
+            for (int i = (int) start; i < std::min((int) std::ceil(end), (int) source.cols()); ++i) {
+                float overlap = std::min(end, i + 1.0f) - std::max(start, (float) i);
+                sum += source(y, i) * overlap;
+            }
+            result(y, x) = sum / scale;
+        }
+    }
+    return result;
+}
+
+/**
+ * \brief Compute a mip-map pyramid using a box filter
+ *
+ * The resolution of every level is half that of the previous one (rounded
+ * down, like \c Imf::ROUND_DOWN), until the last level is a single texel.
+ */
+static std::vector<Bitmap::Base> createMipMap(const Bitmap &bitmap) {
+    std::vector<Bitmap::Base> levels(1, bitmap);
+    while (levels.back().cols() > 1 || levels.back().rows() > 1) {
+        const Bitmap::Base &level = levels.back();
+        int width = std::max((int) level.cols() / 2, 1), height = std::max((int) level.rows() / 2, 1);
+
+        /* Downsample the previous level (separably, rows first) */
+        Bitmap::Base rows = downsample(level.transpose(), height).transpose();
+        levels.push_back(downsample(rows, width));
+    }
+    return levels;
+}
+
+/**
+ * \brief Write a mip-map pyramid to a tiled OpenEXR file
+ *
+ * The file is first written under a temporary name that is unique to this
+ * process and then renamed, so that other processes (which may convert the
+ * same texture concurrently) never read a partially written file.
+ */
+static void writeMipMap(const std::vector<Bitmap::Base> &levels, const std::string &target) {
+#if defined(PLATFORM_WINDOWS)
+    std::string tempFilename = tfm::format("%s.%i.tmp", target, _getpid());
+#else
+    std::string tempFilename = tfm::format("%s.%i.tmp", target, getpid());
+#endif
+
+    try {
+        Imf::TiledRgbaOutputFile file(tempFilename.c_str(), (int) levels[0].cols(), (int) levels[0].rows(),
+            TextureCache::TileSize, TextureCache::TileSize, Imf::MIPMAP_LEVELS,
+            Imf::ROUND_DOWN, Imf::WRITE_RGB);
+        if (file.numLevels() != (int) levels.size())
+            throw NoriException("unexpected number of mip-map levels");
+
+        std::vector<Imf::Rgba> pixels;
+        for (int l=0; l<file.numLevels(); ++l) {
+            const Bitmap::Base &level = levels[l];
+            int width = (int) level.cols(), height = (int) level.rows();
+
+            pixels.resize((size_t) width * height);
+            for (int y=0; y<height; ++y) {
+                for (int x=0; x<width; ++x) {
+                    const Color3f &c = level(y, x);
+                    pixels[(size_t) y * width + x] = Imf::Rgba(c.r(), c.g(), c.b(), 1.0f);
+                }
+            }
+
+            file.setFrameBuffer(pixels.data(), 1, width);
+            file.writeTiles(0, file.numXTiles(l) - 1, 0, file.numYTiles(l) - 1, l);
+        }
+    } catch (...) {
+        std::remove(tempFilename.c_str());
+        throw;
+    }
+
+#if defined(PLATFORM_WINDOWS)
+    /* On Windows, rename() does not replace existing files */
+    std::remove(target.c_str());
+#endif
+    if (std::rename(tempFilename.c_str(), target.c_str()) != 0) {
+        std::remove(tempFilename.c_str());
+        throw NoriException("unable to move the file to \"%s\"", target);
+    }
+}
+
+/**
+ * \brief Image texture backed by the global texture cache
+ *
+ * The image is read from a tiled, mip-mapped OpenEXR file. Other OpenEXR
+ * files are converted into this representation once (the result is stored
+ * next to the original as '<name>.mip.exr' and regenerated when the original
+ * changes). Only the tiles that are actually accessed are kept in memory.
+ * If the converted file cannot be written (e.g. in a read-only directory),
+ * the entire pyramid is kept in memory instead.
+ */
+class BitmapTexture : public Texture, public TextureCache::TileProvider {
+public:
+    BitmapTexture(const PropertyList &propList) {
+        m_filename = getFileResolver()->resolve(propList.getString("filename")).str();
+
+        /* Behavior outside of [0, 1]^2: "repeat" or "clamp" */
+        std::string wrapMode = propList.getString("wrapMode", "repeat");
+        if (wrapMode == "repeat")
+            m_repeat = true;
+        else if (wrapMode == "clamp")
+            m_repeat = false;
+        else
+            throw NoriException("BitmapTexture: unknown wrap mode \"%s\"!", wrapMode);
+
+        /* Texture filter: "nearest", "bilinear" or "trilinear" (mip-mapped) */
+        std::string filter = propList.getString("filter", "trilinear");
+        if (filter == "nearest")
+            m_filter = ENearest;
+        else if (filter == "bilinear")
+            m_filter = EBilinear;
+        else if (filter == "trilinear")
+            m_filter = ETrilinear;
+        else
+            throw NoriException("BitmapTexture: unknown filter \"%s\"!", filter);
+
+        /* Scale factor that is applied to all texels */
+        m_scale = propList.getFloat("scale", 1.0f);
+
+        m_id = TextureCache::getInstance()->registerProvider(this);
+    }
+
+    virtual ~BitmapTexture() {
+        TextureCache::getInstance()->unregisterProvider(m_id);
+    }
+
+    void activate() {
+        std::string mipmapName = m_filename;
+
+        bool tiled = false;
+        if (!Imf::isOpenExrFile(m_filename.c_str(), tiled))
+            throw NoriException("BitmapTexture: \"%s\" is not an OpenEXR file!", m_filename);
+        if (tiled)
+            tiled = Imf::TiledRgbaInputFile(m_filename.c_str()).levelMode() == Imf::MIPMAP_LEVELS;
+
+        if (!tiled) {
+            /* Several textures may refer to the same file */
+            static std::mutex mipmapMutex;
+            std::lock_guard<std::mutex> lock(mipmapMutex);
+
+            mipmapName = m_filename;
+            size_t lastdot = mipmapName.find_last_of(".");
+            if (lastdot != std::string::npos)
+                mipmapName.erase(lastdot, std::string::npos);
+            mipmapName += ".mip.exr";
+
+            if (getFileModificationTime(mipmapName) < getFileModificationTime(m_filename)) {
+                Bitmap bitmap(m_filename);
+
+                cout << "Creating a mip-mapped texture \"" << mipmapName << "\" .. ";
+                cout.flush();
+                Timer timer;
+
+                std::vector<Bitmap::Base> levels = createMipMap(bitmap);
+                try {
+                    writeMipMap(levels, mipmapName);
+                    cout << "done. (" << levels.size() << " levels, took "
+                         << timer.elapsedString() << ")" << endl;
+                } catch (const std::exception &e) {
+                    cout << "failed (" << e.what() << "), keeping it in memory." << endl;
+                    m_memoryLevels = std::move(levels);
+                }
+            }
+        }
+
+        addFileDependency(m_filename);
+        if (!m_memoryLevels.empty()) {
+            m_levels.resize(m_memoryLevels.size());
+            for (size_t l=0; l<m_memoryLevels.size(); ++l)
+                m_levels[l] = Vector2i(m_memoryLevels[l].cols(), m_memoryLevels[l].rows());
+            m_tileSize = Vector2i::Constant(TextureCache::TileSize);
+            return;
+        }
+
+        m_file.reset(new Imf::TiledRgbaInputFile(mipmapName.c_str()));
+        if (mipmapName != m_filename)
+            addFileDependency(mipmapName);
+        m_levels.resize(m_file->numLevels());
+        for (int l=0; l<m_file->numLevels(); ++l)
+            m_levels[l] = Vector2i(m_file->levelWidth(l), m_file->levelHeight(l));
+        m_tileSize = Vector2i(m_file->tileXSize(), m_file->tileYSize());
+        if ((m_tileSize.array() > TextureCache::TileSize).any())
+            throw NoriException("BitmapTexture: \"%s\" uses tiles that are larger than %ix%i texels!",
+                                mipmapName, TextureCache::TileSize, TextureCache::TileSize);
+    }
+
+    std::shared_ptr<TextureCache::Tile> loadTile(int level, int x, int y) const {
+        std::shared_ptr<TextureCache::Tile> tile = std::make_shared<TextureCache::Tile>();
+        Point2i offset(x * m_tileSize.x(), y * m_tileSize.y());
+
+        if (!m_memoryLevels.empty()) {
+            /* Copy the tile from the pyramid in memory (partial tiles at the border) */
+            const Bitmap::Base &source = m_memoryLevels[level];
+            int width = std::min(m_tileSize.x(), (int) source.cols() - offset.x()),
+                height = std::min(m_tileSize.y(), (int) source.rows() - offset.y());
+            for (int j=0; j<height; ++j)
+                for (int i=0; i<width; ++i)
+                    tile->texels[j * TextureCache::TileSize + i] =
+                        source(offset.y() + j, offset.x() + i) * m_scale;
+            return tile;
+        }
+
+        std::vector<Imf::Rgba> pixels(m_tileSize.prod());
+
+        {
+            /* The frame buffer is part of the file's state */
+            std::lock_guard<std::mutex> lock(m_fileMutex);
+            m_file->setFrameBuffer(pixels.data() - offset.x() - offset.y() * m_tileSize.x(),
+                                   1, m_tileSize.x());
+            m_file->readTile(x, y, level);
+        }
+
+        for (int j=0; j<m_tileSize.y(); ++j) {
+            for (int i=0; i<m_tileSize.x(); ++i) {
+                const Imf::Rgba &p = pixels[j * m_tileSize.x() + i];
+                tile->texels[j * TextureCache::TileSize + i] =
+                    Color3f(p.r, p.g, p.b) * m_scale;
+            }
+        }
+        return tile;
+    }
+
+    Color3f eval(const Point2f &uv, float width) const {
+        if (m_filter == ENearest) {
+            const Vector2i &size = m_levels[0];
+            return texel(0, (int) std::floor(uv.x() * size.x()),
+                            (int) std::floor((1.0f - uv.y()) * size.y()));
+        }
+
+        /* Find the pair of levels whose texel size matches the filter footprint */
+        float level = 0.0f;
+        if (m_filter == ETrilinear && width > 0)
+            level = std::log2(std::max(width * m_levels[0].maxCoeff(), 1.0f));
+        level = std::min(level, (float) m_levels.size() - 1.0f);
+
+        int level0 = (int) level;
+        float weight = level - level0;
+        if (weight == 0.0f)
+            return bilinear(level0, uv);
+        return (1.0f - weight) * bilinear(level0, uv) + weight * bilinear(level0 + 1, uv);
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "BitmapTexture[\n"
+            "  filename = \"%s\",\n"
+            "  levels = %i,\n"
+            "  wrapMode = %s,\n"
+            "  filter = %s,\n"
+            "  scale = %f\n"
+            "]",
+            m_filename, m_levels.size(), m_repeat ? "repeat" : "clamp",
+            m_filter == ENearest ? "nearest" : (m_filter == EBilinear ? "bilinear" : "trilinear"),
+            m_scale);
+    }
+protected:
+    enum EFilter {
+        ENearest = 0,
+        EBilinear,
+        ETrilinear
+    };
+
+    /// Look up a single texel (with wrapping)
+    Color3f texel(int level, int x, int y) const {
+        const Vector2i &size = m_levels[level];
+        if (m_repeat) {
+            x %= size.x(); if (x < 0) x += size.x();
+            y %= size.y(); if (y < 0) y += size.y();
+        } else {
+            x = std::min(std::max(x, 0), size.x() - 1);
+            y = std::min(std::max(y, 0), size.y() - 1);
+        }
+
+        const TextureCache::Tile *tile = TextureCache::getInstance()->lookup(
+            m_id, level, x / m_tileSize.x(), y / m_tileSize.y());
+        return tile->texel(x % m_tileSize.x(), y % m_tileSize.y());
+    }
+
+    /// Bilinearly interpolated lookup in one level of the pyramid
+    Color3f bilinear(int level, const Point2f &uv) const {
+        const Vector2i &size = m_levels[level];
+        float x = uv.x() * size.x() - 0.5f, y = (1.0f - uv.y()) * size.y() - 0.5f;
+        int x0 = (int) std::floor(x), y0 = (int) std::floor(y);
+        float fx = x - x0, fy = y - y0;
+
+        /* Fast path: all four texels are part of the same tile */
+        int tx = x0 / m_tileSize.x(), ty = y0 / m_tileSize.y();
+        if (x0 >= 0 && y0 >= 0 && x0 + 1 < size.x() && y0 + 1 < size.y() &&
+            (x0 + 1) / m_tileSize.x() == tx && (y0 + 1) / m_tileSize.y() == ty) {
+            const TextureCache::Tile *tile =
+                TextureCache::getInstance()->lookup(m_id, level, tx, ty);
+            int i = x0 - tx * m_tileSize.x(), j = y0 - ty * m_tileSize.y();
+            return (1.0f - fy) * ((1.0f - fx) * tile->texel(i, j)     + fx * tile->texel(i + 1, j)) +
+                           fy  * ((1.0f - fx) * tile->texel(i, j + 1) + fx * tile->texel(i + 1, j + 1));
+        }
+
+        return (1.0f - fy) * ((1.0f - fx) * texel(level, x0, y0)     + fx * texel(level, x0 + 1, y0)) +
+                       fy  * ((1.0f - fx) * texel(level, x0, y0 + 1) + fx * texel(level, x0 + 1, y0 + 1));
+    }
+
+private:
+    std::string m_filename;
+    bool m_repeat;
+    EFilter m_filter;
+    float m_scale;
+    uint32_t m_id;
+    std::unique_ptr<Imf::TiledRgbaInputFile> m_file;
+    std::vector<Bitmap::Base> m_memoryLevels;
+    mutable std::mutex m_fileMutex;
+    std::vector<Vector2i> m_levels;
+    Vector2i m_tileSize;
+};
+
+NORI_REGISTER_CLASS(BitmapTexture, "bitmap");
+NORI_NAMESPACE_END
@@ -20,6 +20,12 @@
 #include <nori/bitmap.h>
 #include <nori/rfilter.h>
 #include <nori/bbox.h>
+#include <nori/atomic.h>
+#include <nori/trace.h>
+#include <ImfInputFile.h>
+#include <ImfOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfStringAttribute.h>
 #include <tbb/tbb.h>
 
 NORI_NAMESPACE_BEGIN
@@ -37,11 +43,34 @@ ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter)
         }
         m_filter[NORI_FILTER_RESOLUTION] = 0.0f;
         m_lookupFactor = NORI_FILTER_RESOLUTION / m_filterRadius;
+
+        if (filter->isImportanceSampled()) {
+            /* Samples are warped according to the tabulated filter and only
+               contribute to their own pixel, hence no border is needed */
+            m_borderSize = 0;
+            m_filterPDF.reserve(NORI_FILTER_RESOLUTION);
+            float signedSum = 0.0f;
+            for (int i=0; i<NORI_FILTER_RESOLUTION; ++i) {
+                m_filterPDF.append(std::abs(m_filter[i]));
+                signedSum += m_filter[i];
+            }
+            float absSum = m_filterPDF.normalize();
+            if (signedSum <= 0)
+                throw NoriException("ImageBlock: cannot importance sample a filter whose integral is not positive!");
+
+            /* Every sample adds its sign times its value to the pixel. Normalizing
+               by the number of samples times the ratio of the signed and absolute
+               integrals of the (separable) filter yields the filtered value. Unlike
+               the sum of the signs, this never vanishes or becomes negative */
+            m_filterSampleWeight = (signedSum / absSum) * (signedSum / absSum);
+        }
         int weightSize = (int) std::ceil(2*m_filterRadius) + 1;
         m_weightsX = new float[weightSize];
         m_weightsY = new float[weightSize];
+        m_splatRow = new float[4 * weightSize];
         memset(m_weightsX, 0, sizeof(float) * weightSize);
         memset(m_weightsY, 0, sizeof(float) * weightSize);
+        memset(m_splatRow, 0, sizeof(float) * 4 * weightSize);
     }
 
     /* Allocate space for pixels and border regions */
@@ -52,6 +81,7 @@ ImageBlock::~ImageBlock() {
     delete[] m_filter;
     delete[] m_weightsX;
     delete[] m_weightsY;
+    delete[] m_splatRow;
 }
 
 Bitmap *ImageBlock::toBitmap() const {
@@ -71,46 +101,202 @@ void ImageBlock::fromBitmap(const Bitmap &bitmap) {
             coeffRef(y, x) << bitmap.coeff(y, x), 1;
 }
 
-void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
-    if (!value.isValid()) {
-        /* If this happens, go fix your code instead of removing this warning ;) */
-        cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
-        return;
-    }
+void ImageBlock::put(const Point2f &pos, const Color3f &value) {
+    put(&pos, &value, 1);
+}
+
+void ImageBlock::put(const Point2f *positions, const Color3f *values, size_t count) {
+    typedef Eigen::Map<Eigen::Array<float, 4, Eigen::Dynamic>> ColorRow;
+    typedef Eigen::Map<Eigen::ArrayXf> WeightArray;
+
+    /* Shift from image to block pixel coordinates (incl. the half-pixel offset) */
+    Vector2f shift(m_offset.x() - m_borderSize + 0.5f,
+                   m_offset.y() - m_borderSize + 0.5f);
+    BoundingBox2i clip(Point2i(0, 0), Point2i((int) cols() - 1, (int) rows() - 1));
+
+    for (size_t i=0; i<count; ++i) {
+        const Color3f &value = values[i];
+
+        if (!value.isValid()) {
+            /* If this happens, go fix your code instead of removing this warning ;) */
+            cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
+            continue;
+        }
+
+        /* Convert to pixel coordinates within the image block */
+        Point2f pos(positions[i].x() - shift.x(), positions[i].y() - shift.y());
+
+        /* Compute the rectangle of pixels that will need to be updated */
+        BoundingBox2i bbox(
+            Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
+            Point2i((int) std::floor(pos.x() + m_filterRadius), (int) std::floor(pos.y() + m_filterRadius))
+        );
+        bbox.clip(clip);
+
+        int width  = bbox.max.x() - bbox.min.x() + 1,
+            height = bbox.max.y() - bbox.min.y() + 1;
+        if (width <= 0 || height <= 0)
+            continue;
+
+        /* Compute the filter lookup positions for all columns and
+           rows at once, then gather the pre-rasterized filter values */
+        WeightArray weightsX(m_weightsX, width), weightsY(m_weightsY, height);
+        weightsX = ((Eigen::ArrayXf::LinSpaced(width, (float) bbox.min.x(), (float) bbox.max.x())
+                     - pos.x()).abs() * m_lookupFactor);
+        weightsY = ((Eigen::ArrayXf::LinSpaced(height, (float) bbox.min.y(), (float) bbox.max.y())
+                     - pos.y()).abs() * m_lookupFactor);
+        for (int x=0; x<width; ++x)
+            m_weightsX[x] = m_filter[(int) m_weightsX[x]];
+        for (int y=0; y<height; ++y)
+            m_weightsY[y] = m_filter[(int) m_weightsY[y]];
 
-    /* Convert to pixel coordinates within the image block */
-    Point2f pos(
-        _pos.x() - 0.5f - (m_offset.x() - m_borderSize),
-        _pos.y() - 0.5f - (m_offset.y() - m_borderSize)
-    );
-
-    /* Compute the rectangle of pixels that will need to be updated */
-    BoundingBox2i bbox(
-        Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
-        Point2i((int) std::floor(pos.x() + m_filterRadius), (int) std::floor(pos.y() + m_filterRadius))
-    );
-    bbox.clip(BoundingBox2i(Point2i(0, 0), Point2i((int) cols() - 1, (int) rows() - 1)));
-
-    /* Lookup values from the pre-rasterized filter */
-    for (int x=bbox.min.x(), idx = 0; x<=bbox.max.x(); ++x)
-        m_weightsX[idx++] = m_filter[(int) (std::abs(x-pos.x()) * m_lookupFactor)];
-    for (int y=bbox.min.y(), idx = 0; y<=bbox.max.y(); ++y)
-        m_weightsY[idx++] = m_filter[(int) (std::abs(y-pos.y()) * m_lookupFactor)];
-
-    for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) 
-        for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) 
-            coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
+        /* The horizontally filtered sample is the same for every row. Compute
+           it once, and then accumulate scaled copies of it (4 channels per
+           pixel, which maps onto packet operations) into the affected rows */
+        ColorRow splat(m_splatRow, 4, width);
+        splat = Color4f(value).matrix() * weightsX.matrix().transpose();
+
+        for (int y=0; y<height; ++y) {
+            ColorRow row(coeffRef(bbox.min.y() + y, bbox.min.x()).data(), 4, width);
+            row += splat * m_weightsY[y];
+        }
+    }
 }
     
-void ImageBlock::put(ImageBlock &b) {
+Vector2f ImageBlock::sampleFilter(const Point2f &sample, float &weight) const {
+    Vector2f result;
+    weight = 1.0f;
+
+    for (int i=0; i<2; ++i) {
+        /* The filter is symmetric: first choose a side, and then
+           a position according to the tabulated filter values */
+        float u = sample[i] < 0.5f ? 2.0f * sample[i] : 2.0f * sample[i] - 1.0f;
+        size_t index = m_filterPDF.sampleReuse(u);
+        float x = (index + u) / m_lookupFactor;
+        result[i] = sample[i] < 0.5f ? -x : x;
+
+        /* Negative filter lobes turn into negative sample weights */
+        if (m_filter[index] < 0)
+            weight = -weight;
+    }
+
+    return result;
+}
+
+void ImageBlock::put(const Point2i &pixel, const Color3f *values, const float *weights, size_t count) {
+    Color4f &target = coeffRef(pixel.y() - m_offset.y() + m_borderSize,
+                               pixel.x() - m_offset.x() + m_borderSize);
+
+    for (size_t i=0; i<count; ++i) {
+        if (!values[i].isValid()) {
+            /* If this happens, go fix your code instead of removing this warning ;) */
+            cerr << "Integrator: computed an invalid radiance value: " << values[i].toString() << endl;
+            continue;
+        }
+        Color3f value = values[i] * weights[i];
+        target += Color4f(value.r(), value.g(), value.b(), m_filterSampleWeight);
+    }
+}
+
+void ImageBlock::saveEXR(const std::string &filename) const {
+    NORI_TRACE_SCOPE("output", "Write OpenEXR", filename);
+    cout << "Writing a " << m_size.x() << "x" << m_size.y()
+         << " unnormalized OpenEXR file to \"" << filename << "\"" << endl;
+
+    std::string path = filename + ".exr";
+
+    Imf::Header header(m_size.x(), m_size.y());
+    header.insert("comments", Imf::StringAttribute("Generated by Nori (unnormalized)"));
+
+    const char *names[] = { "R", "G", "B", "W" };
+    Imf::ChannelList &channels = header.channels();
+    for (int i=0; i<4; ++i)
+        channels.insert(names[i], Imf::Channel(Imf::FLOAT));
+
+    /* Point the frame buffer at the first pixel after the border region */
+    size_t compStride = sizeof(float),
+           pixelStride = sizeof(Color4f),
+           rowStride = pixelStride * cols();
+    char *ptr = const_cast<char *>(reinterpret_cast<const char *>(
+        &coeff(m_borderSize, m_borderSize)));
+
+    Imf::FrameBuffer frameBuffer;
+    for (int i=0; i<4; ++i)
+        frameBuffer.insert(names[i], Imf::Slice(Imf::FLOAT, ptr + i*compStride, pixelStride, rowStride));
+
+    Imf::OutputFile file(path.c_str(), header);
+    file.setFrameBuffer(frameBuffer);
+    file.writePixels(m_size.y());
+}
+
+void ImageBlock::loadEXR(const std::string &filename) {
+    if (m_borderSize != 0)
+        throw NoriException("ImageBlock::loadEXR(): not supported for blocks with a border region!");
+
+    Imf::InputFile file(filename.c_str());
+    const Imf::ChannelList &channels = file.header().channels();
+    const char *names[] = { "R", "G", "B", "W" };
+    for (int i=0; i<4; ++i) {
+        if (!channels.findChannel(names[i]))
+            throw NoriException("\"%s\" is not an unnormalized OpenEXR file written by "
+                                "Nori (channel \"%s\" is missing)!", filename, names[i]);
+    }
+
+    Imath::Box2i dw = file.header().dataWindow();
+    m_offset = Point2i(0, 0);
+    m_size = Vector2i(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1);
+    resize(m_size.y(), m_size.x());
+
+    size_t compStride = sizeof(float),
+           pixelStride = sizeof(Color4f),
+           rowStride = pixelStride * cols();
+    char *ptr = reinterpret_cast<char *>(data())
+        - dw.min.x * pixelStride - dw.min.y * rowStride;
+
+    Imf::FrameBuffer frameBuffer;
+    for (int i=0; i<4; ++i)
+        frameBuffer.insert(names[i], Imf::Slice(Imf::FLOAT, ptr + i*compStride, pixelStride, rowStride));
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dw.min.y, dw.max.y);
+}
+
+void ImageBlock::put(ImageBlock &b, bool overlapping) {
     Vector2i offset = b.getOffset() - m_offset +
         Vector2i::Constant(m_borderSize - b.getBorderSize());
     Vector2i size   = b.getSize()   + Vector2i(2*b.getBorderSize());
 
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Pixels within two border widths of the edge of 'b' may also receive
+       contributions from neighboring blocks that are merged concurrently */
+    int shared = 2 * b.getBorderSize();
+    if (overlapping)
+        shared = std::max(size.x(), size.y()); /* i.e. all pixels */
 
-    block(offset.y(), offset.x(), size.y(), size.x()) 
-        += b.topLeftCorner(size.y(), size.x());
+    for (int y=0; y<size.y(); ++y) {
+        float *target = coeffRef(offset.y() + y, offset.x()).data();
+        const float *source = b.coeff(y, 0).data();
+        bool sharedRow = y < shared || y >= size.y() - shared;
+
+        for (int x=0; x<size.x(); ++x) {
+            bool sharedPixel = sharedRow || x < shared || x >= size.x() - shared;
+
+            for (int i=0; i<4; ++i) {
+                float value = source[4*x + i];
+                if (sharedPixel)
+                    atomicAdd(target + 4*x + i, value);
+                else
+                    atomicStore(target + 4*x + i, atomicLoad(target + 4*x + i) + value);
+            }
+        }
+    }
+}
+
+void ImageBlock::snapshot(Base &target) const {
+    target.resize(rows(), cols());
+
+    const float *source = coeff(0, 0).data();
+    float *dest = target.coeffRef(0, 0).data();
+    for (ptrdiff_t i=0, n=4*size(); i<n; ++i)
+        dest[i] = atomicLoad(source + i);
 }
 
 std::string ImageBlock::toString() const {
@@ -118,48 +304,101 @@ std::string ImageBlock::toString() const {
         m_offset.toString(), m_size.toString());
 }
 
-BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize)
-        : m_size(size), m_blockSize(blockSize) {
-    m_numBlocks = Vector2i(
+/// Map an index along a Hilbert curve to a position on an n-by-n grid
+static Point2i hilbertCurve(int n, int index) {
+    Point2i p(0, 0);
+    for (int s = 1; s < n; s *= 2) {
+        int rx = 1 & (index / 2),
+            ry = 1 & (index ^ rx);
+
+        /* Rotate the quadrant */
+        if (ry == 0) {
+            if (rx == 1)
+                p = Point2i(s - 1 - p.x(), s - 1 - p.y());
+            std::swap(p.x(), p.y());
+        }
+
+        p += Point2i(s * rx, s * ry);
+        index /= 4;
+    }
+    return p;
+}
+
+BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize,
+        const Point2i &offset, uint32_t passBegin, uint32_t passEnd)
+        : m_offset(offset), m_size(size), m_passBegin(passBegin),
+          m_passEnd(passEnd), m_nextBlock(0) {
+    Vector2i numBlocks(
         (int) std::ceil(size.x() / (float) blockSize),
         (int) std::ceil(size.y() / (float) blockSize));
-    m_blocksLeft = m_numBlocks.x() * m_numBlocks.y();
-    m_direction = ERight;
-    m_block = Point2i(m_numBlocks / 2);
-    m_stepsLeft = 1;
-    m_numSteps = 1;
-}
 
-bool BlockGenerator::next(ImageBlock &block) {
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Traverse a power-of-two grid that covers all blocks along a
+       Hilbert curve, and skip positions that lie outside of the image */
+    int n = 1;
+    while (n < numBlocks.maxCoeff())
+        n *= 2;
+
+    std::vector<Point2i> curve;
+    curve.reserve(numBlocks.x() * numBlocks.y());
+    for (int i=0; i<n*n; ++i) {
+        Point2i p = hilbertCurve(n, i);
+        if ((p.array() < numBlocks.array()).all())
+            curve.push_back(p);
+    }
 
-    if (m_blocksLeft == 0)
-        return false;
+    /* Every pass traverses all blocks */
+    std::vector<std::pair<Point2i, uint32_t>> order;
+    order.reserve(curve.size() * (passEnd - passBegin));
+    for (uint32_t pass = passBegin; pass < passEnd; ++pass)
+        for (const Point2i &p : curve)
+            order.push_back(std::make_pair(p, pass));
 
-    Point2i pos = m_block * m_blockSize;
-    block.setOffset(pos);
-    block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
+    /* Split the last eighth of the blocks into four sub-blocks each, so
+       that the remaining work can be spread more evenly over the threads */
+    size_t splitStart = order.size() - order.size() / 8;
+    int subBlockSize = std::max(1, blockSize / 2);
 
-    if (--m_blocksLeft == 0)
-        return true;
+    for (size_t i=0; i<order.size(); ++i) {
+        Point2i blockOffset = order[i].first * blockSize;
+        Vector2i extent = (size - blockOffset).cwiseMin(Vector2i::Constant(blockSize));
+        uint32_t pass = order[i].second;
+        while (m_passOffsets.size() <= pass - passBegin)
+            m_passOffsets.push_back((int) m_blocks.size());
 
-    do {
-        switch (m_direction) {
-            case ERight: ++m_block.x(); break;
-            case EDown:  ++m_block.y(); break;
-            case ELeft:  --m_block.x(); break;
-            case EUp:    --m_block.y(); break;
+        if (i < splitStart || subBlockSize == blockSize) {
+            m_blocks.push_back(Block { offset + blockOffset, extent, pass });
+            continue;
         }
 
-        if (--m_stepsLeft == 0) {
-            m_direction = (m_direction + 1) % 4;
-            if (m_direction == ELeft || m_direction == ERight) 
-                ++m_numSteps;
-            m_stepsLeft = m_numSteps;
+        for (int j=0; j<4; ++j) {
+            Point2i subOffset(blockOffset.x() + (j & 1) * subBlockSize,
+                              blockOffset.y() + (j >> 1) * subBlockSize);
+            Vector2i subExtent = (blockOffset + extent - subOffset)
+                .cwiseMin(Vector2i::Constant(subBlockSize));
+            if ((subExtent.array() > 0).all())
+                m_blocks.push_back(Block { offset + subOffset, subExtent, pass });
         }
-    } while ((m_block.array() < 0).any() ||
-             (m_block.array() >= m_numBlocks.array()).any());
+    }
+
+    while (m_passOffsets.size() <= passEnd - passBegin)
+        m_passOffsets.push_back((int) m_blocks.size());
+    m_completed.resize(m_blocks.size(), 0);
+}
+
+bool BlockGenerator::next(ImageBlock &block) {
+    int index;
+    return next(block, index);
+}
+
+bool BlockGenerator::next(ImageBlock &block, int &index) {
+    do {
+        index = m_nextBlock++;
+        if (index >= (int) m_blocks.size())
+            return false;
+    } while (m_completed[index]);
 
+    block.setOffset(m_blocks[index].offset);
+    block.setSize(m_blocks[index].size);
     return true;
 }
 
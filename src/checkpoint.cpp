@@ -0,0 +1,202 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/checkpoint.h>
+#include <fstream>
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/* File format: header, one byte per block (completed or not),
+   followed by the raw contents of each film (4 floats per pixel) */
+static const char checkpointMagic[8] = { 'N', 'O', 'R', 'I', 'C', 'K', 'P', 'T' };
+static const uint32_t checkpointVersion = 4;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t borderSize;
+    uint32_t blockCount;
+    uint32_t sampleCount;
+    char samplerType[32];
+    uint32_t seed;
+    int32_t regionX, regionY;
+    uint32_t regionWidth, regionHeight;
+    uint32_t passBegin, passEnd;
+    uint32_t filmCount;
+};
+
+Checkpoint::Checkpoint(const std::string &filename, ImageBlock &film,
+                       BlockGenerator &generator, const Sampler &sampler)
+    : m_filename(filename), m_films(1, &film), m_generator(generator),
+      m_sampleCount((uint32_t) sampler.getSampleCount()), m_seed(sampler.getSeed()) {
+    /* Identify the sampler by the class name in its description,
+       e.g. "Independent" for "Independent[sampleCount=..]" */
+    std::string description = sampler.toString();
+    m_samplerType = description.substr(0, description.find('['));
+    if (m_samplerType.size() >= sizeof(CheckpointHeader::samplerType))
+        m_samplerType.resize(sizeof(CheckpointHeader::samplerType) - 1);
+}
+
+void Checkpoint::put(ImageBlock * const *blocks, int index) {
+    /* Merges are lock-free with respect to each other -- the lock only
+       keeps them from running while a checkpoint is being taken */
+    tbb::spin_rw_mutex::scoped_lock lock(m_mutex, false);
+
+    /* With several passes, the same tile may be merged concurrently */
+    bool overlapping = m_generator.getPassEnd() - m_generator.getPassBegin() > 1;
+    for (size_t i=0; i<m_films.size(); ++i)
+        m_films[i]->put(*blocks[i], overlapping);
+    m_generator.setCompleted(index);
+}
+
+void Checkpoint::save() {
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(CheckpointHeader));
+    memcpy(header.magic, checkpointMagic, sizeof(checkpointMagic));
+    header.version = checkpointVersion;
+    header.width = (uint32_t) m_films[0]->getSize().x();
+    header.height = (uint32_t) m_films[0]->getSize().y();
+    header.borderSize = (uint32_t) m_films[0]->getBorderSize();
+    header.blockCount = (uint32_t) m_generator.getBlockCount();
+    header.sampleCount = m_sampleCount;
+    memcpy(header.samplerType, m_samplerType.c_str(), m_samplerType.size());
+    header.seed = m_seed;
+    header.regionX = m_generator.getOffset().x();
+    header.regionY = m_generator.getOffset().y();
+    header.regionWidth = (uint32_t) m_generator.getSize().x();
+    header.regionHeight = (uint32_t) m_generator.getSize().y();
+    header.passBegin = m_generator.getPassBegin();
+    header.passEnd = m_generator.getPassEnd();
+    header.filmCount = (uint32_t) m_films.size();
+
+    std::vector<uint8_t> completed(header.blockCount);
+    std::vector<ImageBlock::Base> films(m_films.size());
+
+    {
+        /* Briefly stop all merges to obtain a consistent snapshot */
+        tbb::spin_rw_mutex::scoped_lock lock(m_mutex, true);
+        for (uint32_t i=0; i<header.blockCount; ++i)
+            completed[i] = m_generator.isCompleted((int) i) ? 1 : 0;
+        for (size_t i=0; i<m_films.size(); ++i)
+            m_films[i]->snapshot(films[i]);
+    }
+
+    std::string tempFilename = m_filename + ".tmp";
+    FILE *file = fopen(tempFilename.c_str(), "wb");
+    if (!file)
+        throw NoriException("Unable to write the checkpoint \"%s\"!", tempFilename);
+    bool success =
+        fwrite(&header, sizeof(CheckpointHeader), 1, file) == 1 &&
+        fwrite(completed.data(), 1, completed.size(), file) == completed.size();
+    for (const ImageBlock::Base &film : films)
+        success = success && fwrite(film.data(), sizeof(Color4f), film.size(), file) == (size_t) film.size();
+
+    /* Make sure that the data has reached the disk before the rename
+       below. Otherwise, a crash of the host may leave behind an empty
+       or partially written file under the final name */
+    success = success && fflush(file) == 0;
+#if defined(_WIN32)
+    success = success && _commit(_fileno(file)) == 0;
+#else
+    success = success && fsync(fileno(file)) == 0;
+#endif
+    success = fclose(file) == 0 && success;
+    if (!success) {
+        std::remove(tempFilename.c_str());
+        throw NoriException("Unable to write the checkpoint \"%s\"!", tempFilename);
+    }
+
+#if defined(_WIN32)
+    /* On Windows, rename() does not replace existing files */
+    std::remove(m_filename.c_str());
+#endif
+    if (std::rename(tempFilename.c_str(), m_filename.c_str()) != 0)
+        throw NoriException("Unable to move the checkpoint to \"%s\"!", m_filename);
+}
+
+bool Checkpoint::load() {
+    std::ifstream is(m_filename, std::ios::binary);
+    if (!is.good())
+        return false;
+
+    CheckpointHeader header;
+    is.read((char *) &header, sizeof(CheckpointHeader));
+    if (!is.good() || memcmp(header.magic, checkpointMagic, sizeof(checkpointMagic)) != 0
+                   || header.version != checkpointVersion)
+        throw NoriException("\"%s\" is not a valid checkpoint file!", m_filename);
+
+    if (header.width != (uint32_t) m_films[0]->getSize().x() ||
+        header.height != (uint32_t) m_films[0]->getSize().y() ||
+        header.borderSize != (uint32_t) m_films[0]->getBorderSize() ||
+        header.filmCount != (uint32_t) m_films.size() ||
+        header.blockCount != (uint32_t) m_generator.getBlockCount() ||
+        header.sampleCount != m_sampleCount ||
+        header.seed != m_seed ||
+        strncmp(header.samplerType, m_samplerType.c_str(), sizeof(header.samplerType)) != 0 ||
+        header.regionX != m_generator.getOffset().x() ||
+        header.regionY != m_generator.getOffset().y() ||
+        header.regionWidth != (uint32_t) m_generator.getSize().x() ||
+        header.regionHeight != (uint32_t) m_generator.getSize().y() ||
+        header.passBegin != m_generator.getPassBegin() ||
+        header.passEnd != m_generator.getPassEnd())
+        throw NoriException("The checkpoint \"%s\" was created with different rendering "
+                            "settings (%ix%i pixels, %s sampler with %i spp and seed %i, "
+                            "crop window [%i, %i]-[%i, %i], passes %i-%i, %i films)!",
+                            m_filename, header.width, header.height,
+                            std::string(header.samplerType, strnlen(header.samplerType,
+                                sizeof(header.samplerType))),
+                            header.sampleCount, header.seed, header.regionX, header.regionY,
+                            header.regionX + (int) header.regionWidth,
+                            header.regionY + (int) header.regionHeight,
+                            header.passBegin, header.passEnd, header.filmCount);
+
+    std::vector<uint8_t> completed(header.blockCount);
+    is.read((char *) completed.data(), completed.size());
+    for (ImageBlock *film : m_films)
+        is.read((char *) film->data(), sizeof(Color4f) * film->size());
+    if (!is.good())
+        throw NoriException("The checkpoint \"%s\" is truncated!", m_filename);
+
+    for (uint32_t i=0; i<header.blockCount; ++i) {
+        if (completed[i])
+            m_generator.setCompleted((int) i);
+    }
+
+    return true;
+}
+
+void Checkpoint::remove() {
+    std::remove(m_filename.c_str());
+}
+
+int Checkpoint::getCompletedBlockCount() const {
+    int count = 0;
+    for (int i=0; i<m_generator.getBlockCount(); ++i)
+        count += m_generator.isCompleted(i) ? 1 : 0;
+    return count;
+}
+
+NORI_NAMESPACE_END
@@ -17,10 +17,14 @@
 */
 
 #include <nori/bsdf.h>
+#include <nori/emitter.h>
 #include <nori/warp.h>
 #include <pcg32.h>
 #include <hypothesis.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <fstream>
+#include <functional>
 #include <memory>
 
 /*
@@ -38,6 +42,15 @@ NORI_NAMESPACE_BEGIN
  * \brief Statistical test for validating that an importance sampling routine
  * (e.g. from a BSDF) produces a distribution that agrees with what the
  * implementation claims via its associated density function.
+ *
+ * Besides BSDFs, environment emitters can be tested as well: their
+ * directions are sampled using \ref Emitter::sampleEnvironment() and
+ * compared against \ref Emitter::pdfEnvironment(). Since they do not
+ * depend on an incident direction, each of them is only tested once.
+ *
+ * The samples are drawn in parallel, in chunks of a fixed size that each
+ * use their own PCG stream. The histograms of the chunks are summed in a
+ * fixed order, hence the result does not depend on the number of threads.
  */
 class ChiSquareTest : public NoriObject {
 public:
@@ -75,6 +88,8 @@ public:
     virtual ~ChiSquareTest() {
         for (auto bsdf : m_bsdfs)
             delete bsdf;
+        for (auto emitter : m_emitters)
+            delete emitter;
     }
 
     void addChild(NoriObject *obj) {
@@ -83,6 +98,15 @@ public:
                 m_bsdfs.push_back(static_cast<BSDF *>(obj));
                 break;
 
+            case EEmitter: {
+                    Emitter *emitter = static_cast<Emitter *>(obj);
+                    if (!emitter->isEnvironment())
+                        throw NoriException("ChiSquareTest::addChild(): only environment "
+                                            "emitters can be tested!");
+                    m_emitters.push_back(emitter);
+                }
+                break;
+
             default:
                 throw NoriException("ChiSquareTest::addChild(<%s>) is not supported!",
                     classTypeName(obj->getClassType()));
@@ -91,20 +115,14 @@ public:
 
     /// Execute the chi-square test
     void activate() {
-        int passed = 0, total = 0, res = m_cosThetaResolution*m_phiResolution;
+        int passed = 0, total = 0;
+        int testTotal = m_testCount * (int) m_bsdfs.size() + (int) m_emitters.size();
         pcg32 random; /* Pseudorandom number generator */
 
-        std::unique_ptr<double[]> obsFrequencies(new double[res]);
-        std::unique_ptr<double[]> expFrequencies(new double[res]);
-
-
         /* Test each registered BSDF */
         for (auto bsdf : m_bsdfs) {
             /* Run several tests per BSDF to be on the safe side */
             for (int l = 0; l<m_testCount; ++l) {
-                memset(obsFrequencies.get(), 0, res*sizeof(double));
-                memset(expFrequencies.get(), 0, res*sizeof(double));
-
                 cout << "------------------------------------------------------" << endl;
                 cout << "Testing: " << bsdf->toString() << endl;
                 ++total;
@@ -115,80 +133,41 @@ public:
                 sincosf(2.0f * M_PI * random.nextFloat(), &sinPhi, &cosPhi);
                 Vector3f wi(cosPhi * sinTheta, sinPhi * sinTheta, cosTheta);
 
-                cout << "Accumulating " << m_sampleCount << " samples into a " << m_cosThetaResolution
-                     << "x" << m_phiResolution << " contingency table .. ";
-                cout.flush();
-
-                /* Generate many samples from the BSDF and create
-                   a histogram / contingency table */
-                BSDFQueryRecord bRec(wi);
-                for (int i=0; i<m_sampleCount; ++i) {
-                    Point2f sample(random.nextFloat(), random.nextFloat());
+                auto sample = [&](const Point2f &sample, Vector3f &wo) -> bool {
+                    BSDFQueryRecord bRec(wi);
                     Color3f result = bsdf->sample(bRec, sample);
+                    wo = bRec.wo;
+                    return !(result.array() == 0).all();
+                };
 
-                    if ((result.array() == 0).all())
-                        continue;
+                auto pdf = [&](const Vector3f &wo) -> double {
+                    BSDFQueryRecord bRec(wi, wo, ESolidAngle);
+                    return bsdf->pdf(bRec);
+                };
 
-                    int cosThetaBin = std::min(std::max(0, (int) std::floor((bRec.wo.z()*0.5f+0.5f)
-                            * m_cosThetaResolution)), m_cosThetaResolution-1);
-
-                    float scaledPhi = std::atan2(bRec.wo.y(), bRec.wo.x()) * INV_TWOPI;
-                    if (scaledPhi < 0)
-                        scaledPhi += 1;
+                if (runTest(sample, pdf, random.nextUInt(), total, testTotal))
+                    ++passed;
+            }
+        }
 
-                    int phiBin = std::min(std::max(0,
-                        (int) std::floor(scaledPhi * m_phiResolution)), m_phiResolution-1);
-                    obsFrequencies[cosThetaBin * m_phiResolution + phiBin] += 1;
-                }
-                cout << "done." << endl;
-
-                /* Numerically integrate the probability density
-                   function over rectangles in spherical coordinates. */
-                double *ptr = expFrequencies.get();
-                cout << "Integrating expected frequencies .. ";
-                cout.flush();
-                for (int i=0; i<m_cosThetaResolution; ++i) {
-                    double cosThetaStart = -1.0 + i     * 2.0 / m_cosThetaResolution;
-                    double cosThetaEnd   = -1.0 + (i+1) * 2.0 / m_cosThetaResolution;
-                    for (int j=0; j<m_phiResolution; ++j) {
-                        double phiStart = j     * 2*M_PI / m_phiResolution;
-                        double phiEnd   = (j+1) * 2*M_PI / m_phiResolution;
-
-                        auto integrand = [&](double cosTheta, double phi) -> double {
-                            double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
-                            double sinPhi = std::sin(phi), cosPhi = std::cos(phi);
-
-                            Vector3f wo((float) (sinTheta * cosPhi),
-                                        (float) (sinTheta * sinPhi),
-                                        (float) cosTheta);
-
-                            BSDFQueryRecord bRec(wi, wo, ESolidAngle);
-                            return bsdf->pdf(bRec);
-                        };
-
-                        double integral = hypothesis::adaptiveSimpson2D(
-                            integrand, cosThetaStart, phiStart, cosThetaEnd,
-                            phiEnd);
-
-                        *ptr++ = integral * m_sampleCount;
-                    }
-                }
-                cout << "done." << endl;
+        /* Test each registered environment emitter */
+        for (auto emitter : m_emitters) {
+            cout << "------------------------------------------------------" << endl;
+            cout << "Testing: " << emitter->toString() << endl;
+            ++total;
 
-                /* Write the test input data to disk for debugging */
-                hypothesis::chi2_dump(m_cosThetaResolution, m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
-                    tfm::format("chi2test_%i.m", total));
+            auto sample = [&](const Point2f &sample, Vector3f &wo) -> bool {
+                float pdf;
+                emitter->sampleEnvironment(wo, pdf, sample);
+                return pdf > 0;
+            };
 
-                /* Perform the Chi^2 test */
-                std::pair<bool, std::string> result =
-                    hypothesis::chi2_test(m_cosThetaResolution*m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
-                        m_sampleCount, m_minExpFrequency, m_significanceLevel, m_testCount * (int) m_bsdfs.size());
+            auto pdf = [&](const Vector3f &wo) -> double {
+                return emitter->pdfEnvironment(wo);
+            };
 
-                if (result.first)
-                    ++passed;
-
-                cout << result.second << endl;
-            }
+            if (runTest(sample, pdf, random.nextUInt(), total, testTotal))
+                ++passed;
         }
 
         cout << "Passed " << passed << "/" << total << " tests." << endl;
@@ -216,6 +195,119 @@ public:
 
     EClassType getClassType() const { return ETest; }
 private:
+    /**
+     * \brief Compare the histogram of many samples against the integrated density
+     *
+     * \param sampleDirection
+     *    Maps a uniform sample on [0, 1]^2 to a direction. Returns \c false
+     *    when sampling failed (the sample is then discarded).
+     * \param pdf
+     *    Solid angle density of a direction
+     * \param seed
+     *    Seed of the PCG streams that generate the samples
+     * \param index
+     *    Index of the test (used for the name of the debug output)
+     * \param testTotal
+     *    Total number of tests (for the Sidak correction)
+     */
+    bool runTest(const std::function<bool(const Point2f &, Vector3f &)> &sampleDirection,
+                 const std::function<double(const Vector3f &)> &pdf,
+                 uint64_t seed, int index, int testTotal) {
+        int res = m_cosThetaResolution*m_phiResolution;
+        std::unique_ptr<double[]> obsFrequencies(new double[res]);
+        std::unique_ptr<double[]> expFrequencies(new double[res]);
+        memset(obsFrequencies.get(), 0, res*sizeof(double));
+        memset(expFrequencies.get(), 0, res*sizeof(double));
+
+        cout << "Accumulating " << m_sampleCount << " samples into a " << m_cosThetaResolution
+             << "x" << m_phiResolution << " contingency table .. ";
+        cout.flush();
+
+        /* Generate many samples and create
+           a histogram / contingency table (one per chunk) */
+        const int chunkSize = 16384;
+        int chunkCount = (m_sampleCount + chunkSize - 1) / chunkSize;
+        std::vector<uint32_t> chunkFrequencies((size_t) chunkCount * res, 0);
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, chunkCount),
+            [&](const tbb::blocked_range<int> &range) {
+                for (int chunk = range.begin(); chunk != range.end(); ++chunk) {
+                    pcg32 rng(seed, (uint64_t) chunk);
+                    uint32_t *frequencies = chunkFrequencies.data() + (size_t) chunk * res;
+                    int end = std::min(m_sampleCount, (chunk + 1) * chunkSize);
+
+                    for (int i = chunk * chunkSize; i < end; ++i) {
+                        Point2f sample(rng.nextFloat(), rng.nextFloat());
+                        Vector3f wo;
+                        if (!sampleDirection(sample, wo))
+                            continue;
+
+                        int cosThetaBin = std::min(std::max(0, (int) std::floor((wo.z()*0.5f+0.5f)
+                                * m_cosThetaResolution)), m_cosThetaResolution-1);
+
+                        float scaledPhi = std::atan2(wo.y(), wo.x()) * INV_TWOPI;
+                        if (scaledPhi < 0)
+                            scaledPhi += 1;
+
+                        int phiBin = std::min(std::max(0,
+                            (int) std::floor(scaledPhi * m_phiResolution)), m_phiResolution-1);
+                        frequencies[cosThetaBin * m_phiResolution + phiBin] += 1;
+                    }
+                }
+            }
+        );
+
+        for (int chunk = 0; chunk < chunkCount; ++chunk) {
+            for (int i = 0; i < res; ++i)
+                obsFrequencies[i] += chunkFrequencies[(size_t) chunk * res + i];
+        }
+        cout << "done." << endl;
+
+        /* Numerically integrate the probability density
+           function over rectangles in spherical coordinates. */
+        double *ptr = expFrequencies.get();
+        cout << "Integrating expected frequencies .. ";
+        cout.flush();
+        tbb::parallel_for(0, m_cosThetaResolution, [&](int i) {
+            double cosThetaStart = -1.0 + i     * 2.0 / m_cosThetaResolution;
+            double cosThetaEnd   = -1.0 + (i+1) * 2.0 / m_cosThetaResolution;
+            for (int j=0; j<m_phiResolution; ++j) {
+                double phiStart = j     * 2*M_PI / m_phiResolution;
+                double phiEnd   = (j+1) * 2*M_PI / m_phiResolution;
+
+                auto integrand = [&](double cosTheta, double phi) -> double {
+                    double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
+                    double sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+
+                    Vector3f wo((float) (sinTheta * cosPhi),
+                                (float) (sinTheta * sinPhi),
+                                (float) cosTheta);
+
+                    return pdf(wo);
+                };
+
+                double integral = hypothesis::adaptiveSimpson2D(
+                    integrand, cosThetaStart, phiStart, cosThetaEnd,
+                    phiEnd);
+
+                ptr[i * m_phiResolution + j] = integral * m_sampleCount;
+            }
+        });
+        cout << "done." << endl;
+
+        /* Write the test input data to disk for debugging */
+        hypothesis::chi2_dump(m_cosThetaResolution, m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
+            tfm::format("chi2test_%i.m", index));
+
+        /* Perform the Chi^2 test */
+        std::pair<bool, std::string> result =
+            hypothesis::chi2_test(m_cosThetaResolution*m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
+                m_sampleCount, m_minExpFrequency, m_significanceLevel, testTotal);
+
+        cout << result.second << endl;
+        return result.first;
+    }
+
     int m_cosThetaResolution;
     int m_phiResolution;
     int m_minExpFrequency;
@@ -223,6 +315,7 @@ private:
     int m_testCount;
     float m_significanceLevel;
     std::vector<BSDF *> m_bsdfs;
+    std::vector<Emitter *> m_emitters;
 };
 
 NORI_REGISTER_CLASS(ChiSquareTest, "chi2test");
@@ -0,0 +1,177 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Correlated multi-jittered sampler
+ *
+ * Implements the correlated multi-jittered (CMJ) patterns by Kensler
+ * ("Correlated Multi-Jittered Sampling", Pixar Technical Memo 13-01).
+ * Every call to \ref next2D() draws from a 2D pattern that is stratified
+ * both on a grid and along each axis (like an N-rooks pattern), and every
+ * call to \ref next1D() draws from a stratified 1D pattern. Arbitrary
+ * sample counts are supported, although square numbers work best.
+ *
+ * The patterns are generated on the fly from hash-based permutations, so
+ * that each pixel, dimension and rendering pass uses a different pattern
+ * without storing any tables.
+ */
+class CMJSampler : public Sampler {
+public:
+    CMJSampler(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+
+        /* Seed of the patterns (renderings with different seeds are independent) */
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+
+        configure();
+    }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<CMJSampler> cloned(new CMJSampler());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
+        cloned->configure();
+        return cloned;
+    }
+
+    void setSampleCount(size_t sampleCount) {
+        m_sampleCount = sampleCount;
+        configure();
+    }
+
+    void prepare(const ImageBlock &, uint32_t pass) {
+        m_pass = pass;
+    }
+
+    void generate(const Point2i &pixel) {
+        m_pixelSeed = hash({ (uint32_t) pixel.x(), (uint32_t) pixel.y(), m_pass, m_seed });
+        m_sampleIndex = 0;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t p = hash({ m_pixelSeed, m_dimension++ });
+        uint32_t n = (uint32_t) m_sampleCount;
+        uint32_t s = permute(m_sampleIndex, n, p * 0x68bc21ebu);
+        return std::min((s + randfloat(m_sampleIndex, p * 0x02e5be93u)) / n, OneMinusEpsilon);
+    }
+
+    Point2f next2D() {
+        uint32_t p = hash({ m_pixelSeed, m_dimension++ });
+        uint32_t m = m_columns, n = m_rows;
+
+        /* Shuffle the order of the samples (only relevant when the
+           pattern has more cells than there are samples) */
+        uint32_t s = permute(m_sampleIndex, (uint32_t) m_sampleCount, p * 0x51633e2du);
+
+        uint32_t sx = permute(s % m, m, p * 0xa511e9b3u);
+        uint32_t sy = permute(s / m, n, p * 0x63d83595u);
+        float jx = randfloat(s, p * 0xa399d265u);
+        float jy = randfloat(s, p * 0x711ad6a5u);
+
+        return Point2f(
+            std::min((s % m + (sy + jx) / n) / m, OneMinusEpsilon),
+            std::min((s / m + (sx + jy) / m) / n, OneMinusEpsilon)
+        );
+    }
+
+    void next1DArray(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = CMJSampler::next1D();
+    }
+
+    void next2DArray(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = CMJSampler::next2D();
+    }
+
+    uint32_t getSeed() const { return m_seed; }
+
+    std::string toString() const {
+        return tfm::format("CMJSampler[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    CMJSampler() { }
+
+    /// Determine the resolution of the 2D grid (m x n >= number of samples)
+    void configure() {
+        if (m_sampleCount == 0)
+            throw NoriException("CMJSampler: the sample count must be positive!");
+        m_columns = std::max((uint32_t) std::sqrt((float) m_sampleCount), 1u);
+        m_rows = ((uint32_t) m_sampleCount + m_columns - 1) / m_columns;
+    }
+
+    /// Hash-based permutation of the integers [0, l) (Kensler, Listing 3)
+    static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+        uint32_t w = l - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do {
+            i ^= p; i *= 0xe170893du;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8; i *= 0x0929eb3fu;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1; i *= 1 | p >> 27;
+            i *= 0x6935fa69u;
+            i ^= (i & w) >> 11; i *= 0x74dcb303u;
+            i ^= (i & w) >> 2; i *= 0x9e501cc3u;
+            i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+
+    /// Hash-based uniform random number in [0, 1) (Kensler, Listing 4)
+    static float randfloat(uint32_t i, uint32_t p) {
+        i ^= p;
+        i ^= i >> 17;
+        i ^= i >> 10; i *= 0xb36534e5u;
+        i ^= i >> 12;
+        i ^= i >> 21; i *= 0x93fc4795u;
+        i ^= 0xdf6e307fu;
+        i ^= i >> 17; i *= 1 | p >> 18;
+        return (float) (i >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint32_t m_seed = 0;
+    uint32_t m_pass = 0;
+    uint32_t m_columns = 1, m_rows = 1;
+    uint32_t m_pixelSeed = 0;
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(CMJSampler, "cmj");
+NORI_NAMESPACE_END
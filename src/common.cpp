@@ -21,13 +21,19 @@
 #include <Eigen/LU>
 #include <filesystem/resolver.h>
 #include <iomanip>
-
-#if defined(PLATFORM_LINUX)
-#include <malloc.h>
-#endif
+#include <mutex>
+#include <sys/stat.h>
 
 #if defined(PLATFORM_WINDOWS)
 #include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(PLATFORM_LINUX)
+#include <malloc.h>
 #endif
 
 #if defined(PLATFORM_MACOS)
@@ -170,11 +176,90 @@ std::string memString(size_t size, bool precise) {
     return os.str();
 }
 
+size_t getPeakMemoryUsage() {
+#if defined(PLATFORM_WINDOWS)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (size_t) counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(PLATFORM_MACOS)
+    return (size_t) usage.ru_maxrss;        /* bytes */
+#else
+    return (size_t) usage.ru_maxrss * 1024; /* kilobytes */
+#endif
+#endif
+}
+
 filesystem::resolver *getFileResolver() {
     static filesystem::resolver *resolver = new filesystem::resolver();
     return resolver;
 }
 
+int64_t getFileModificationTime(const std::string &filename) {
+    /* Whole seconds are too coarse: a file that is written twice within the
+       same second (e.g. by a script that exports a scene) must not look unchanged */
+#if defined(PLATFORM_WINDOWS)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data))
+        return -1;
+    /* 100 ns intervals since January 1, 1601 */
+    return (int64_t) (((uint64_t) data.ftLastWriteTime.dwHighDateTime << 32) |
+                      (uint64_t) data.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return -1;
+#if defined(PLATFORM_MACOS)
+    const struct timespec &mtime = st.st_mtimespec;
+#else
+    const struct timespec &mtime = st.st_mtim;
+#endif
+    /* Nanoseconds since the epoch */
+    return (int64_t) mtime.tv_sec * 1000000000 + (int64_t) mtime.tv_nsec;
+#endif
+}
+
+/// Files recorded by \ref addFileDependency() (objects may be loaded in parallel)
+struct FileDependencies {
+    std::mutex mutex;
+    bool recording = false;
+    std::vector<std::string> filenames;
+};
+
+static FileDependencies *getFileDependencies() {
+    static FileDependencies *dependencies = new FileDependencies();
+    return dependencies;
+}
+
+void startFileDependencyRecording() {
+    FileDependencies *dependencies = getFileDependencies();
+    std::lock_guard<std::mutex> lock(dependencies->mutex);
+    dependencies->recording = true;
+    dependencies->filenames.clear();
+}
+
+std::vector<std::string> stopFileDependencyRecording() {
+    FileDependencies *dependencies = getFileDependencies();
+    std::lock_guard<std::mutex> lock(dependencies->mutex);
+    dependencies->recording = false;
+    std::vector<std::string> filenames;
+    filenames.swap(dependencies->filenames);
+    return filenames;
+}
+
+void addFileDependency(const std::string &filename) {
+    FileDependencies *dependencies = getFileDependencies();
+    std::lock_guard<std::mutex> lock(dependencies->mutex);
+    if (dependencies->recording &&
+        std::find(dependencies->filenames.begin(), dependencies->filenames.end(),
+                  filename) == dependencies->filenames.end())
+        dependencies->filenames.push_back(filename);
+}
+
 Color3f Color3f::toSRGB() const {
     Color3f result;
 
@@ -268,6 +353,34 @@ void coordinateSystem(const Vector3f &a, Vector3f &b, Vector3f &c) {
     b = c.cross(a);
 }
 
+float erfinv(float x) {
+    float w = -std::log((1.0f - x) * (1.0f + x)), p;
+    if (w < 5.0f) {
+        w = w - 2.5f;
+        p = 2.81022636e-08f;
+        p = 3.43273939e-07f + p * w;
+        p = -3.5233877e-06f + p * w;
+        p = -4.39150654e-06f + p * w;
+        p = 0.00021858087f + p * w;
+        p = -0.00125372503f + p * w;
+        p = -0.00417768164f + p * w;
+        p = 0.246640727f + p * w;
+        p = 1.50140941f + p * w;
+    } else {
+        w = std::sqrt(w) - 3.0f;
+        p = -0.000200214257f;
+        p = 0.000100950558f + p * w;
+        p = 0.00134934322f + p * w;
+        p = -0.00367342844f + p * w;
+        p = 0.00573950773f + p * w;
+        p = -0.0076224613f + p * w;
+        p = 0.00943887047f + p * w;
+        p = 1.00167406f + p * w;
+        p = 2.83297682f + p * w;
+    }
+    return p * x;
+}
+
 float fresnel(float cosThetaI, float extIOR, float intIOR) 
 {
     float etaI = extIOR, etaT = intIOR;
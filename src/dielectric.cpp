@@ -21,9 +21,11 @@
 #include <nori/warp.h>
 #include <fstream>
 #include <nori/frame.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_COUNTER(statDielectricSamples, "BSDF samples", "dielectric");
 
 /// Ideal dielectric BSDF
 class Dielectric : public BSDF {
@@ -81,6 +83,7 @@ public:
 
     Color3f sample(BSDFQueryRecord &bRec, const Point2f &sample) const
 	{
+		NORI_STAT_ADD(statDielectricSamples, 1);
 
 		float etaI = m_extIOR;
 		float etaT = m_intIOR;
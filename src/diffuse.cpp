@@ -19,9 +19,13 @@
 #include <nori/bsdf.h>
 #include <nori/frame.h>
 #include <nori/warp.h>
+#include <nori/texture.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_COUNTER(statDiffuseSamples, "BSDF samples", "diffuse");
+
 /**
  * \brief Diffuse / Lambertian BRDF model
  */
@@ -31,6 +35,23 @@ public:
         m_albedo = propList.getColor("albedo", Color3f(0.5f));
     }
 
+    virtual ~Diffuse() {
+        delete m_albedoTexture;
+    }
+
+    /// Return the albedo at the surface position associated with a query
+    Color3f evalAlbedo(const BSDFQueryRecord &bRec) const {
+        if (m_albedoTexture && bRec.its.mesh)
+            return m_albedoTexture->eval(bRec.its.uv, bRec.its.uvWidth);
+        return m_albedo;
+    }
+
+    Color3f getAlbedo(const Intersection &its) const {
+        if (m_albedoTexture)
+            return m_albedoTexture->eval(its.uv, its.uvWidth);
+        return m_albedo;
+    }
+
     /// Evaluate the BRDF model
     Color3f eval(const BSDFQueryRecord &bRec) const 
 	{
@@ -44,7 +65,7 @@ public:
            return Color3f(0.0f);
 
         /* The BRDF is simply the albedo / pi */
-        return m_albedo * INV_PI;
+        return evalAlbedo(bRec) * INV_PI;
     }
 
     /// Compute the density of \ref sample() wrt. solid angles
@@ -68,6 +89,7 @@ public:
 
     /// Draw a a sample from the BRDF model
     Color3f sample(BSDFQueryRecord &bRec, const Point2f &sample) const {
+        NORI_STAT_ADD(statDiffuseSamples, 1);
         if (Frame::cosTheta(bRec.wi) <= 0)
             return Color3f(0.0f);
 
@@ -82,7 +104,17 @@ public:
 
         /* eval() / pdf() * cos(theta) = albedo. There
            is no need to call these functions. */
-        return m_albedo;
+        return evalAlbedo(bRec);
+    }
+
+    void addChild(NoriObject *obj) {
+        if (obj->getClassType() != ETexture ||
+            static_cast<Texture *>(obj)->getName() != "albedo")
+            throw NoriException("Diffuse::addChild(<%s>) is not supported!",
+                classTypeName(obj->getClassType()));
+        if (m_albedoTexture)
+            throw NoriException("Diffuse: tried to register multiple albedo textures!");
+        m_albedoTexture = static_cast<Texture *>(obj);
     }
 
     bool isDiffuse() const {
@@ -94,7 +126,7 @@ public:
         return tfm::format(
             "Diffuse[\n"
             "  albedo = %s\n"
-            "]", m_albedo.toString());
+            "]", m_albedoTexture ? indent(m_albedoTexture->toString()) : m_albedo.toString());
     }
 
 
@@ -102,6 +134,7 @@ public:
     EClassType getClassType() const { return EBSDF; }
 private:
     Color3f m_albedo;
+    Texture *m_albedoTexture = nullptr;
 };
 
 NORI_REGISTER_CLASS(Diffuse, "diffuse");
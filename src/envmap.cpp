@@ -0,0 +1,214 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/emitter.h>
+#include <nori/bitmap.h>
+#include <nori/dpdf.h>
+#include <nori/warp.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Environment emitter that is backed by a latitude-longitude
+ * (equirectangular) OpenEXR image
+ *
+ * The image covers the sphere of directions: its columns span the azimuth
+ * and its rows span the polar angle, starting at the "up" direction (+Y in
+ * the local frame of the emitter, which is specified by \c toWorld).
+ *
+ * Directions are importance sampled proportionally to the luminance of the
+ * texels times sin(theta), which accounts for the compression of the rows
+ * towards the poles. A row is chosen using a marginal distribution and a
+ * column using the conditional distribution of that row, each by binary
+ * search (O(log n)). Since the radiance is constant per texel, the density
+ * of a direction can be looked up exactly in O(1), e.g. for MIS weights.
+ */
+class EnvironmentMap : public Emitter {
+public:
+    EnvironmentMap(const PropertyList &propList) {
+        m_filename = getFileResolver()->resolve(propList.getString("filename")).str();
+
+        /* Scale factor that is applied to the radiance of all texels */
+        m_scale = propList.getFloat("scale", 1.0f);
+
+        /* Orientation of the environment (maps local to world directions) */
+        m_toWorld = propList.getTransform("toWorld", Transform());
+        m_toLocal = m_toWorld.inverse();
+
+        /* Sample directions uniformly instead (e.g. for comparisons) */
+        m_importanceSample = propList.getBoolean("importanceSample", true);
+    }
+
+    void activate() {
+        cout << "Building the environment map sampling distribution .. ";
+        cout.flush();
+        Timer timer;
+
+        m_bitmap = Bitmap(m_filename);
+        addFileDependency(m_filename);
+        int width = (int) m_bitmap.cols(), height = (int) m_bitmap.rows();
+        if (width == 0 || height == 0)
+            throw NoriException("EnvironmentMap: \"%s\" is empty!", m_filename);
+
+        m_rows.assign(height, DiscretePDF(width));
+        m_marginal.clear();
+        m_marginal.reserve(height);
+        m_average = Color3f(0.0f);
+
+        for (int y=0; y<height; ++y) {
+            float sinTheta = std::sin(M_PI * (y + 0.5f) / height);
+            DiscretePDF &row = m_rows[y];
+            for (int x=0; x<width; ++x) {
+                const Color3f &value = m_bitmap(y, x);
+                row.append(std::max(value.getLuminance(), 0.0f) * sinTheta);
+                m_average += value * sinTheta;
+            }
+            m_marginal.append(row.normalize());
+        }
+        m_marginal.normalize();
+
+        /* Average radiance over the sphere (the rows have a solid angle of about 2*pi*sin(theta)*pi/height) */
+        m_average *= m_scale * (float) (M_PI * M_PI * 2 / (width * height)) * INV_FOURPI;
+
+        cout << "done. (" << width << "x" << height << ", took "
+             << timer.elapsedString() << ")" << endl;
+    }
+
+    bool isEnvironment() const { return true; }
+
+    Color3f evalEnvironment(const Vector3f &d) const {
+        Point2f uv = toUV(m_toLocal * d);
+        return lookup(uv);
+    }
+
+    Color3f sampleEnvironment(Vector3f &d, float &pdf, const Point2f &sample) const {
+        if (!m_importanceSample) {
+            d = Warp::squareToUniformSphere(sample);
+            pdf = Warp::squareToUniformSpherePdf(d);
+            return evalEnvironment(d) / pdf;
+        }
+
+        if (!m_marginal.isNormalized()) {
+            /* The environment is black */
+            pdf = 0.0f;
+            return Color3f(0.0f);
+        }
+
+        /* Choose a row and a column and then a uniformly distributed position within the texel */
+        float sy = sample.y(), sx = sample.x();
+        size_t y = m_marginal.sampleReuse(sy);
+        if (!m_rows[y].isNormalized()) {
+            /* Only happens for samples on the boundary of a black row */
+            pdf = 0.0f;
+            return Color3f(0.0f);
+        }
+        size_t x = m_rows[y].sampleReuse(sx);
+        float texelDensity = texelPdf(x, y);
+        Point2f uv((x + sx) / m_bitmap.cols(), (y + sy) / m_bitmap.rows());
+
+        float theta = uv.y() * M_PI, phi = uv.x() * 2 * M_PI;
+        float sinTheta = std::sin(theta);
+        if (texelDensity <= 0 || sinTheta <= 0) {
+            pdf = 0.0f;
+            return Color3f(0.0f);
+        }
+
+        Vector3f local(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+        d = (m_toWorld * local).normalized();
+        pdf = texelDensity / (2 * M_PI * M_PI * sinTheta);
+        return m_bitmap(y, x) * m_scale / pdf;
+    }
+
+    float pdfEnvironment(const Vector3f &d) const {
+        if (!m_importanceSample)
+            return Warp::squareToUniformSpherePdf(d);
+        if (!m_marginal.isNormalized())
+            return 0.0f;
+
+        Vector3f local = (m_toLocal * d).normalized();
+        float sinTheta = std::sqrt(std::max(0.0f, 1 - local.y() * local.y()));
+        if (sinTheta <= 0)
+            return 0.0f;
+
+        Point2i texel = toTexel(toUV(local));
+        return texelPdf(texel.x(), texel.y()) / (2 * M_PI * M_PI * sinTheta);
+    }
+
+    /// Average radiance over all directions
+    Color3f getRad() const { return m_average; }
+
+    /// Not used: environment emitters are sampled using \ref sampleEnvironment()
+    Point2f sample2D() const { return Point2f(0.5f, 0.5f); }
+
+    std::string toString() const {
+        return tfm::format(
+            "EnvironmentMap[\n"
+            "  filename = \"%s\",\n"
+            "  scale = %f,\n"
+            "  importanceSample = %s,\n"
+            "  toWorld = %s\n"
+            "]", m_filename, m_scale, m_importanceSample ? "true" : "false",
+            indent(m_toWorld.toString(), 12));
+    }
+private:
+    /// Map a direction in the local frame to latitude-longitude coordinates on [0, 1]^2
+    static Point2f toUV(const Vector3f &d) {
+        Vector3f n = d.normalized();
+        float phi = std::atan2(n.z(), n.x());
+        if (phi < 0)
+            phi += 2 * M_PI;
+        float theta = std::acos(clamp(n.y(), -1.0f, 1.0f));
+        return Point2f(phi * INV_TWOPI, theta * INV_PI);
+    }
+
+    /// Return the texel that contains the given latitude-longitude coordinates
+    Point2i toTexel(const Point2f &uv) const {
+        int width = (int) m_bitmap.cols(), height = (int) m_bitmap.rows();
+        return Point2i(clamp((int) (uv.x() * width), 0, width - 1),
+                       clamp((int) (uv.y() * height), 0, height - 1));
+    }
+
+    /// Nearest-neighbor lookup (matches the piecewise constant sampling density)
+    Color3f lookup(const Point2f &uv) const {
+        Point2i texel = toTexel(uv);
+        return m_bitmap(texel.y(), texel.x()) * m_scale;
+    }
+
+    /// Density of the texel (x, y) with respect to the area of [0, 1]^2
+    float texelPdf(size_t x, size_t y) const {
+        if (!m_rows[y].isNormalized())
+            return 0.0f;
+        return m_marginal[y] * m_rows[y][x] * (float) (m_bitmap.cols() * m_bitmap.rows());
+    }
+
+    std::string m_filename;
+    float m_scale;
+    Transform m_toWorld, m_toLocal;
+    bool m_importanceSample;
+    Bitmap m_bitmap;
+    Color3f m_average;
+
+    /// Marginal distribution of the rows and conditional distributions of the columns
+    DiscretePDF m_marginal;
+    std::vector<DiscretePDF> m_rows;
+};
+
+NORI_REGISTER_CLASS(EnvironmentMap, "envmap");
+NORI_NAMESPACE_END
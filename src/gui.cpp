@@ -7,8 +7,9 @@
 
 NORI_NAMESPACE_BEGIN
 
-NoriScreen::NoriScreen(const ImageBlock &block)
- : nanogui::Screen(block.getSize() + Vector2i(0, 36), "Nori", false), m_block(block) {
+NoriScreen::NoriScreen(const ImageBlock &block, const RenderProgress *progress)
+ : nanogui::Screen(block.getSize() + Vector2i(0, 36), "Nori", false), m_block(block),
+   m_progress(progress) {
     using namespace nanogui;
 
     /* Add some UI elements to adjust the exposure value */
@@ -24,6 +25,13 @@ NoriScreen::NoriScreen(const ImageBlock &block)
         }
     );
 
+    /* Show the progress next to the slider (with a fixed width, so that
+       the layout does not need to be updated when the text changes) */
+    if (m_progress) {
+        m_progressLabel = new Label(panel, "", "sans");
+        m_progressLabel->setFixedWidth(340);
+    }
+
     panel->setSize(block.getSize());
     performLayout(mNVGContext);
 
@@ -92,18 +100,23 @@ NoriScreen::~NoriScreen() {
 }
 
 void NoriScreen::drawContents() {
+    if (m_progressLabel)
+        m_progressLabel->setCaption(m_progress->toString());
+
+    /* Take a snapshot of the partially rendered image. This does not
+       block the rendering threads that are concurrently writing to it */
+    m_block.snapshot(m_snapshot);
+
     /* Reload the partially rendered image onto the GPU */
-    m_block.lock();
     int borderSize = m_block.getBorderSize();
     const Vector2i &size = m_block.getSize();
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, m_texture);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint) m_block.cols());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint) m_snapshot.cols());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x(), size.y(),
-            0, GL_RGBA, GL_FLOAT, (uint8_t *) m_block.data() +
-            (borderSize * m_block.cols() + borderSize) * sizeof(Color4f));
+            0, GL_RGBA, GL_FLOAT, (uint8_t *) m_snapshot.data() +
+            (borderSize * m_snapshot.cols() + borderSize) * sizeof(Color4f));
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    m_block.unlock();
 
     glViewport(0, GLsizei(36 * mPixelRatio), GLsizei(mPixelRatio*size[0]),
          GLsizei(mPixelRatio*size[1]));
@@ -18,7 +18,7 @@
 
 #include <nori/sampler.h>
 #include <nori/block.h>
-#include <pcg32.h>
+#include <nori/pcgbatch.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -29,11 +29,21 @@ NORI_NAMESPACE_BEGIN
  * This class is essentially just a wrapper around the pcg32 pseudorandom
  * number generator. For more details on what sample generators do in
  * general, refer to the \ref Sampler class.
+ *
+ * Every pixel sample draws from its own pcg32 stream, which is seeded
+ * from the pixel, the index of the sample and the rendering pass. The
+ * d-th dimension of a sample is the d-th output of its stream. Hence,
+ * the samples neither depend on the block size nor on the order in
+ * which pixels are rendered, and any pixel sample can be regenerated
+ * in isolation.
  */
 class Independent : public Sampler {
 public:
     Independent(const PropertyList &propList) {
         m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+
+        /* Seed of the streams (renderings with different seeds are independent) */
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
     }
 
     virtual ~Independent() { }
@@ -41,39 +51,69 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
         cloned->m_random = m_random;
         return std::move(cloned);
     }
 
-    void prepare(const ImageBlock &block) {
-        m_random.seed(
-            block.getOffset().x(),
-            block.getOffset().y()
-        );
+    void prepare(const ImageBlock &, uint32_t pass) {
+        m_pass = pass;
+    }
+
+    void generate(const Point2i &pixel) {
+        m_pixel = pixel;
+        m_sampleIndex = 0;
+        seedSample();
     }
 
-    void generate() { /* No-op for this sampler */ }
-    void advance()  { /* No-op for this sampler */ }
+    void advance() {
+        ++m_sampleIndex;
+        seedSample();
+    }
 
     float next1D() {
         return m_random.nextFloat();
     }
     
     Point2f next2D() {
-        return Point2f(
-            m_random.nextFloat(),
-            m_random.nextFloat()
-        );
+        /* The evaluation order of function arguments is unspecified,
+           hence draw the components in a fixed order (as next2DArray() does) */
+        float x = m_random.nextFloat();
+        float y = m_random.nextFloat();
+        return Point2f(x, y);
+    }
+
+    void next1DArray(float *values, size_t count) {
+        pcg32NextFloats(m_random, values, count);
+    }
+
+    void next2DArray(Point2f *values, size_t count) {
+        static_assert(sizeof(Point2f) == 2 * sizeof(float), "Point2f must be tightly packed");
+        pcg32NextFloats(m_random, reinterpret_cast<float *>(values), 2 * count);
     }
 
+    uint32_t getSeed() const { return m_seed; }
+
     std::string toString() const {
-        return tfm::format("Independent[sampleCount=%i]", m_sampleCount);
+        return tfm::format("Independent[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
     }
 protected:
     Independent() { }
 
+    /// Start the stream of the current pixel sample
+    void seedSample() {
+        uint32_t x = (uint32_t) m_pixel.x(), y = (uint32_t) m_pixel.y();
+        uint64_t state = ((uint64_t) hash({ x, y, m_pass, m_sampleIndex, m_seed }) << 32)
+                       | hash({ m_seed, m_sampleIndex, m_pass, y, x });
+        m_random.seed(state, hash({ x, y, m_pass, m_seed }));
+    }
+
 private:
     pcg32 m_random;
+    uint32_t m_seed = 0;
+    uint32_t m_pass = 0;
+    Point2i m_pixel = Point2i(0, 0);
+    uint32_t m_sampleIndex = 0;
 };
 
 NORI_REGISTER_CLASS(Independent, "independent");
@@ -25,15 +25,69 @@
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
+#include <nori/checkpoint.h>
+#include <nori/texcache.h>
+#include <nori/denoiser.h>
+#include <nori/stats.h>
+#include <nori/trace.h>
+#include <nori/progress.h>
+#include <nori/accel.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
+#include <nori/mesh.h>
 #include <filesystem/resolver.h>
+#include <pugixml.hpp>
 #include <thread>
+#include <atomic>
+#include <fstream>
+#include <condition_variable>
 
 using namespace nori;
 
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
-    const Camera *camera = scene->getCamera();
+/**
+ * \brief Films of the arbitrary output variables (AOVs) that are recorded
+ * along with the image: first the standard AOVs of the scene, followed
+ * by those of the integrator
+ */
+struct AOVFilms {
+    std::vector<std::unique_ptr<ImageBlock>> films;
+
+    AOVFilms(size_t count, const Vector2i &size, const ReconstructionFilter *filter) {
+        for (size_t i=0; i<count; ++i)
+            films.emplace_back(new ImageBlock(size, filter));
+    }
+
+    /// Cover the same pixels as \c block and clear the contents
+    void prepare(const ImageBlock &block) {
+        for (auto &film : films) {
+            film->setOffset(block.getOffset());
+            film->setSize(block.getSize());
+            film->clear();
+        }
+    }
+
+    void clear() {
+        for (auto &film : films)
+            film->clear();
+    }
+};
+
+/// Return the names of all AOVs, in the order of the films in \ref AOVFilms
+static std::vector<std::string> getAOVNames(const Scene *scene) {
+    std::vector<std::string> names = scene->getAOVNames();
+    for (const std::string &name : scene->getIntegrator()->getAOVNames()) {
+        if (std::find(names.begin(), names.end(), name) != names.end())
+            throw NoriException("The integrator's AOV \"%s\" conflicts with another AOV!", name);
+        names.push_back(name);
+    }
+    return names;
+}
+
+NORI_STAT_COUNTER(statCameraRays, "Integrator", "Camera rays");
+NORI_STAT_HISTOGRAM(statPathLength, "Integrator", "Path length (closest-hit rays per sample)", 17);
+
+static void renderBlock(const Scene *scene, const Camera *camera, Sampler *sampler,
+                        ImageBlock &block, AOVFilms *aovs = nullptr) {
     const Integrator *integrator = scene->getIntegrator();
 
     Point2i offset = block.getOffset();
@@ -41,119 +95,875 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block)
 
     /* Clear the block contents */
     block.clear();
+    if (aovs)
+        aovs->prepare(block);
+
+    /* Samples are recorded in the block one pixel at a time */
+    std::vector<Point2f> positions(sampler->getSampleCount());
+    std::vector<Color3f> values(sampler->getSampleCount());
+
+    /* AOV values are stored film by film, i.e. at index 'film * sampleCount + sample' */
+    size_t aovCount = aovs ? aovs->films.size() : 0;
+    std::vector<Color3f> aovValues(aovCount * sampler->getSampleCount());
+    std::vector<Color3f> sampleAOVs(aovCount);
+    std::vector<float> weights(sampler->getSampleCount(), 1.0f);
+    bool filterImportanceSampled = block.isFilterImportanceSampled();
 
     /* For each pixel and pixel sample sample */
     for (int y=0; y<size.y(); ++y) {
         for (int x=0; x<size.x(); ++x) {
+            Point2i pixel(x + offset.x(), y + offset.y());
+            sampler->generate(pixel);
+
             for (uint32_t i=0; i<sampler->getSampleCount(); ++i) {
-                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
-                Point2f apertureSample = sampler->next2D();
+                /* Fetch the position and aperture samples at once */
+                Point2f cameraSamples[2];
+                sampler->next2DArray(cameraSamples, 2);
+
+                Point2f pixelSample;
+                if (filterImportanceSampled)
+                    pixelSample = pixel.cast<float>() + Vector2f::Constant(0.5f)
+                        + block.sampleFilter(cameraSamples[0], weights[i]);
+                else
+                    pixelSample = pixel.cast<float>() + cameraSamples[0];
 
                 /* Sample a ray from the camera */
                 Ray3f ray;
-                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+                Color3f value = camera->sampleRay(ray, pixelSample, cameraSamples[1]);
+
+                NORI_STAT_ADD(statCameraRays, 1);
+
+                /* Compute the incident radiance and the AOVs */
+                if (aovs)
+                    std::fill(sampleAOVs.begin(), sampleAOVs.end(), Color3f(0.0f));
+
+#if defined(NORI_ENABLE_STATS)
+                /* The path length is the number of closest-hit rays traced by the integrator */
+                int64_t closestHitRays = statClosestHitRays.getThreadValue();
+#endif
+
+                if (aovs) {
+                    value *= integrator->Li(scene, sampler, ray, sampleAOVs.data());
+                    for (size_t k=0; k<aovCount; ++k)
+                        aovValues[k * sampler->getSampleCount() + i] = sampleAOVs[k];
+                } else {
+                    value *= integrator->Li(scene, sampler, ray);
+                }
+                NORI_STAT_HISTOGRAM_ADD(statPathLength,
+                    statClosestHitRays.getThreadValue() - closestHitRays);
+
+                positions[i] = pixelSample;
+                values[i] = value;
+
+                /* Move on to the next pixel sample */
+                sampler->advance();
+            }
 
-                /* Compute the incident radiance */
-                value *= integrator->Li(scene, sampler, ray);
+            /* Store in the image block */
+            if (filterImportanceSampled)
+                block.put(pixel, values.data(), weights.data(), values.size());
+            else
+                block.put(positions.data(), values.data(), positions.size());
+
+            for (size_t k=0; k<aovCount; ++k) {
+                const Color3f *data = aovValues.data() + k * sampler->getSampleCount();
+                if (filterImportanceSampled)
+                    aovs->films[k]->put(pixel, data, weights.data(), values.size());
+                else
+                    aovs->films[k]->put(positions.data(), data, positions.size());
+            }
+        }
+    }
+}
+
+/// Command line options that affect the rendering process
+struct RenderOptions {
+    /// Interval between checkpoints in seconds (zero: no checkpoints)
+    float checkpointInterval = 0.0f;
+
+    /// Resume from a previously written checkpoint?
+    bool resume = false;
+
+    /// Show the partially rendered image in a window?
+    bool gui = true;
+
+    /// Only render a crop window of the image? (zero size: entire image)
+    Point2i cropOffset = Point2i(0, 0);
+    Vector2i cropSize = Vector2i(0, 0);
+
+    /// Range of rendering passes (each of which uses all pixel samples)
+    uint32_t passBegin = 0, passEnd = 1;
+
+    /// Base name of the output files (derived from the scene file if empty)
+    std::string outputName;
+
+    /// Write the unnormalized film so that it can later be merged?
+    bool partial = false;
+
+    /// Reference image for measuring the convergence after every pass (optional)
+    std::string referenceName;
+
+    /// Chrome trace JSON file that records a timeline of the rendering (optional)
+    std::string traceName;
+
+    /// Interval between progress reports in seconds (zero: no reports)
+    float progressInterval = 0.0f;
+
+    /// Format of the progress reports
+    RenderProgress::EFormat progressFormat = RenderProgress::EText;
+
+    /// Stream that receives the progress reports
+    std::ostream *progressStream = &std::cout;
+};
+
+/**
+ * \brief Records the error of a progressive rendering with respect to a
+ * (high sample count) reference image after every pass
+ *
+ * The mean squared error (MSE) and the relative MSE, i.e. the squared
+ * error divided by the squared reference value plus 0.01, are averaged
+ * over the rendered pixels and color channels and are written to a CSV
+ * file along with the elapsed rendering time.
+ */
+class ConvergenceLog {
+public:
+    ConvergenceLog(const std::string &referenceName, const std::string &filename,
+                   const Vector2i &outputSize, const Point2i &offset, const Vector2i &size)
+        : m_reference(referenceName), m_filename(filename), m_offset(offset), m_size(size) {
+        if (m_reference.cols() != outputSize.x() || m_reference.rows() != outputSize.y())
+            throw NoriException("The reference image \"%s\" has a resolution of %ix%i, "
+                                "expected %ix%i!", referenceName, m_reference.cols(),
+                                m_reference.rows(), outputSize.x(), outputSize.y());
+        m_file.open(filename);
+        if (!m_file)
+            throw NoriException("Unable to write \"%s\"!", filename);
+        m_file << "passes,spp,seconds,mse,relmse" << endl;
+    }
 
-                /* Store in the image block */
-                block.put(pixelSample, value);
+    /// Compare the film against the reference and append a line to the log
+    void record(const ImageBlock &film, uint32_t passes, uint32_t sampleCount, double time) {
+        std::unique_ptr<Bitmap> bitmap(film.toBitmap());
+        double mse = 0, relMSE = 0;
+        for (int y = m_offset.y(); y < m_offset.y() + m_size.y(); ++y) {
+            for (int x = m_offset.x(); x < m_offset.x() + m_size.x(); ++x) {
+                const Color3f &value = bitmap->coeff(y, x), &ref = m_reference.coeff(y, x);
+                for (int c = 0; c < 3; ++c) {
+                    double diff2 = (double) (value[c] - ref[c]) * (value[c] - ref[c]);
+                    mse += diff2;
+                    relMSE += diff2 / ((double) ref[c] * ref[c] + 1e-2);
+                }
             }
         }
+        double count = 3.0 * m_size.prod();
+        mse /= count;
+        relMSE /= count;
+
+        m_file << tfm::format("%u,%u,%.6f,%.8g,%.8g", passes, passes * sampleCount,
+                              time / 1000.0, mse, relMSE) << endl;
+        cout << tfm::format("Pass %u: %s, MSE = %.6g, relMSE = %.6g", passes,
+                            timeString(time, true), mse, relMSE) << endl;
     }
+
+    const std::string &getFilename() const { return m_filename; }
+private:
+    Bitmap m_reference;
+    std::string m_filename;
+    std::ofstream m_file;
+    Point2i m_offset;
+    Vector2i m_size;
+};
+
+/**
+ * Merge several unnormalized partial renderings (written using '--partial')
+ * of the same scene, e.g. different crop windows or passes
+ */
+static void merge(const std::string &outputName, const std::vector<std::string> &filenames) {
+    ImageBlock result(Vector2i(0, 0), nullptr);
+    ImageBlock partial(Vector2i(0, 0), nullptr);
+
+    for (size_t i=0; i<filenames.size(); ++i) {
+        if (i == 0) {
+            result.loadEXR(filenames[i]);
+            continue;
+        }
+
+        partial.loadEXR(filenames[i]);
+        if (partial.getSize() != result.getSize())
+            throw NoriException("\"%s\" has a different resolution than \"%s\"!",
+                                filenames[i], filenames[0]);
+        result += partial;
+    }
+
+    /* Dividing the sum of the color channels by the sum of the weights
+       yields exactly the image that a single process would have rendered */
+    std::unique_ptr<Bitmap> bitmap(result.toBitmap());
+    bitmap->saveEXR(outputName);
+    bitmap->savePNG(outputName);
 }
 
-static void render(Scene *scene, const std::string &filename) {
-    const Camera *camera = scene->getCamera();
-    Vector2i outputSize = camera->getOutputSize();
+/// Film, work scheduler and checkpoint of one of the views that are rendered
+struct View {
+    const Camera *camera = nullptr;
+    std::string outputName;
+    std::unique_ptr<BlockGenerator> blockGenerator;
+    std::unique_ptr<ImageBlock> result;
+    std::unique_ptr<AOVFilms> aovs;
+    std::unique_ptr<Checkpoint> checkpoint;
+};
+
+static void render(Scene *scene, const std::string &filename, const RenderOptions &options) {
     scene->getIntegrator()->preprocess(scene);
+    TextureCache::getInstance()->resetStatistics();
+
+    /* Determine the filename of the output bitmap */
+    std::string outputName = options.outputName;
+    if (outputName.empty()) {
+        outputName = filename;
+        size_t lastdot = outputName.find_last_of(".");
+        if (lastdot != std::string::npos)
+            outputName.erase(lastdot, std::string::npos);
+    }
+
+    /* Arbitrary output variables (and the denoiser's features) */
+    std::vector<std::string> aovNames = getAOVNames(scene);
+    if (!aovNames.empty() && options.partial)
+        cout << "Warning: AOVs are not recorded in partial renderings" << endl;
+
+    /* Every camera of the scene is rendered into a separate set of output
+       files. The blocks of all views are scheduled in a single parallel loop
+       (view by view), so that no thread idles when one view is finished.
+       'viewOffsets' holds the index of the first block of each view. */
+    size_t viewCount = scene->getCameraCount();
+    std::vector<View> views(viewCount);
+    std::vector<int> viewOffsets(viewCount + 1, 0);
+
+    for (size_t v=0; v<viewCount; ++v) {
+        View &view = views[v];
+        view.camera = scene->getCamera(v);
+        view.outputName = viewCount == 1 ? outputName : tfm::format("%s_%03i", outputName, v);
+        Vector2i outputSize = view.camera->getOutputSize();
+
+        /* Determine the part of the image that should be rendered */
+        Point2i cropOffset(0, 0);
+        Vector2i cropSize = outputSize;
+        if (options.cropSize.prod() > 0) {
+            cropOffset = options.cropOffset.cwiseMax(0).cwiseMin(outputSize);
+            cropSize = (options.cropOffset + options.cropSize).cwiseMin(outputSize) - cropOffset;
+            if ((cropSize.array() <= 0).any())
+                throw NoriException("The crop window does not overlap the image!");
+        }
+
+        /* Create a block generator (i.e. a work scheduler) */
+        view.blockGenerator.reset(new BlockGenerator(cropSize, NORI_BLOCK_SIZE,
+            cropOffset, options.passBegin, options.passEnd));
+
+        /* Allocate memory for the entire output image and clear it */
+        view.result.reset(new ImageBlock(outputSize, view.camera->getReconstructionFilter()));
+        view.result->clear();
+
+        /* Allocate memory for the AOVs (partial renderings only store the image) */
+        if (!aovNames.empty() && !options.partial) {
+            view.aovs.reset(new AOVFilms(aovNames.size(), outputSize,
+                view.camera->getReconstructionFilter()));
+            view.aovs->clear();
+        }
+
+        /* Rendered blocks are merged through the checkpoint manager, which
+           keeps track of the blocks that have been completed so far */
+        view.checkpoint.reset(new Checkpoint(view.outputName + ".checkpoint",
+            *view.result, *view.blockGenerator, *scene->getSampler()));
+        if (view.aovs) {
+            for (auto &film : view.aovs->films)
+                view.checkpoint->addFilm(*film);
+        }
+        if (options.resume) {
+            if (view.checkpoint->load())
+                cout << "Resuming from \"" << view.checkpoint->getFilename() << "\" ("
+                     << view.checkpoint->getCompletedBlockCount() << "/"
+                     << view.blockGenerator->getBlockCount() << " blocks completed)" << endl;
+            else
+                cout << "Checkpoint \"" << view.checkpoint->getFilename()
+                     << "\" not found, starting from scratch" << endl;
+        }
 
-    /* Create a block generator (i.e. a work scheduler) */
-    BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+        viewOffsets[v + 1] = viewOffsets[v] + view.blockGenerator->getBlockCount();
+    }
 
-    /* Allocate memory for the entire output image and clear it */
-    ImageBlock result(outputSize, camera->getReconstructionFilter());
-    result.clear();
+    /* Measure the convergence towards a reference image after every pass */
+    std::unique_ptr<ConvergenceLog> convergence;
+    if (!options.referenceName.empty()) {
+        if (viewCount > 1 || options.partial || options.resume)
+            throw NoriException("Convergence measurements require a single camera view "
+                                "and are incompatible with partial or resumed renderings!");
+        const BlockGenerator &generator = *views[0].blockGenerator;
+        convergence.reset(new ConvergenceLog(options.referenceName,
+            views[0].outputName + "_convergence.csv", views[0].camera->getOutputSize(),
+            generator.getOffset(), generator.getSize()));
+    }
 
-    /* Create a window that visualizes the partially rendered result */
-    nanogui::init();
-    NoriScreen *screen = new NoriScreen(result);
+    /* Keep track of the completed blocks of all views */
+    int completedBlockCount = 0;
+    for (View &view : views)
+        completedBlockCount += view.checkpoint->getCompletedBlockCount();
+    RenderProgress progress(viewOffsets.back(), completedBlockCount);
+
+    /* Create a window that visualizes the partially rendered result (of the first view) */
+    NoriScreen *screen = nullptr;
+    if (options.gui) {
+        nanogui::init();
+        screen = new NoriScreen(*views[0].result, &progress);
+    }
+
+    /* Periodically write checkpoints while rendering */
+    std::mutex checkpointMutex;
+    std::condition_variable checkpointCondition;
+    bool renderingDone = false;
+    std::thread checkpoint_thread;
+    if (options.checkpointInterval > 0) {
+        checkpoint_thread = std::thread([&] {
+            std::unique_lock<std::mutex> lock(checkpointMutex);
+            auto interval = std::chrono::milliseconds(
+                (int64_t) (options.checkpointInterval * 1000));
+            while (!checkpointCondition.wait_for(lock, interval, [&] { return renderingDone; })) {
+                for (View &view : views) {
+                    try {
+                        view.checkpoint->save();
+                    } catch (const std::exception &e) {
+                        cerr << "Warning: " << e.what() << endl;
+                    }
+                }
+            }
+        });
+    }
 
     /* Do the following in parallel and asynchronously */
+    std::exception_ptr renderError;
     std::thread render_thread([&] {
-        cout << "Rendering .. ";
+        if (viewCount > 1)
+            cout << "Rendering " << viewCount << " views .. ";
+        else
+            cout << "Rendering .. ";
+        if (options.progressInterval > 0) {
+            cout << endl;
+            progress.start(options.progressInterval, options.progressFormat,
+                           *options.progressStream);
+        }
         cout.flush();
         Timer timer;
 
-        tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
+        tbb::blocked_range<int> range(0, viewOffsets.back());
+        std::atomic<int> nextBlock(0);
 
         auto map = [&](const tbb::blocked_range<int> &range) {
-            /* Allocate memory for a small image block to be rendered
-               by the current thread */
-            ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                camera->getReconstructionFilter());
+            /* Allocate memory for small image blocks to be rendered by the
+               current thread (one per view, since their filters may differ) */
+            std::vector<std::unique_ptr<ImageBlock>> blocks(viewCount);
+            std::vector<std::unique_ptr<AOVFilms>> aovs(viewCount);
 
             /* Create a clone of the sampler for the current thread */
             std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
 
             for (int i=range.begin(); i<range.end(); ++i) {
-                /* Request an image block from the block generator */
-                blockGenerator.next(block);
+                /* Find the view that the next block belongs to */
+                int ticket = nextBlock++;
+                size_t v = std::upper_bound(viewOffsets.begin(), viewOffsets.end(),
+                                            ticket) - viewOffsets.begin() - 1;
+                View &view = views[v];
+                if (!blocks[v])
+                    blocks[v].reset(new ImageBlock(Vector2i(NORI_BLOCK_SIZE),
+                        view.camera->getReconstructionFilter()));
+                ImageBlock &block = *blocks[v];
+                if (view.aovs && !aovs[v])
+                    aovs[v].reset(new AOVFilms(aovNames.size(), Vector2i(NORI_BLOCK_SIZE),
+                        view.camera->getReconstructionFilter()));
+
+                /* Request an image block from the view's block generator */
+                int index;
+                if (!view.blockGenerator->next(block, index))
+                    continue;
 
                 /* Inform the sampler about the block to be rendered */
-                sampler->prepare(block);
+                sampler->prepare(block, view.blockGenerator->getPass(index));
 
                 /* Render all contained pixels */
-                renderBlock(scene, sampler.get(), block);
+                uint64_t rayCount = Accel::getThreadRayCount();
+                {
+                    NORI_TRACE_SCOPE("render", "Render block", index);
+                    renderBlock(scene, view.camera, sampler.get(), block, aovs[v].get());
+                }
+                progress.update((int64_t) block.getSize().prod() * sampler->getSampleCount(),
+                                (int64_t) (Accel::getThreadRayCount() - rayCount));
 
                 /* The image block has been processed. Now add it to
                    the "big" block that represents the entire image */
-                result.put(block);
+                NORI_TRACE_SCOPE("render", "Merge block", index);
+                if (aovs[v]) {
+                    std::vector<ImageBlock *> films(1, &block);
+                    for (auto &film : aovs[v]->films)
+                        films.push_back(film.get());
+                    view.checkpoint->put(films.data(), index);
+                } else {
+                    view.checkpoint->put(block, index);
+                }
             }
         };
 
-        /// Uncomment the following line for single threaded rendering
-        // map(range);
+        try {
+            /// Uncomment the following line for single threaded rendering
+            // map(range);
+
+            if (convergence) {
+                /* Blocks are handed out pass by pass. Render one pass at a time
+                   and compare against the reference in between (untimed) */
+                const BlockGenerator &generator = *views[0].blockGenerator;
+                double renderTime = 0;
+                cout << endl;
+                for (uint32_t pass = options.passBegin; pass < options.passEnd; ++pass) {
+                    /* Passes may consist of different numbers of blocks */
+                    int blockCount = generator.getPassOffset(pass + 1) - generator.getPassOffset(pass);
+                    Timer passTimer;
+                    tbb::parallel_for(tbb::blocked_range<int>(0, blockCount), map);
+                    renderTime += passTimer.elapsed();
+                    convergence->record(*views[0].result, pass - options.passBegin + 1,
+                        (uint32_t) scene->getSampler()->getSampleCount(), renderTime);
+                }
+            } else {
+                /// Default: parallel rendering
+                tbb::parallel_for(range, map);
+            }
+
+            progress.stop();
+            cout << "done. (took " << timer.elapsedString() << ")" << endl;
 
-        /// Default: parallel rendering
-        tbb::parallel_for(range, map);
+#if defined(NORI_ENABLE_STATS)
+            Statistics::print(cout);
+#endif
 
-        cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            if (TextureCache::getInstance()->getLookupCount() > 0)
+                cout << TextureCache::getInstance()->toString() << endl;
+        } catch (...) {
+            /* Forward the error to the calling thread */
+            progress.stop();
+            cout << "failed." << endl;
+            renderError = std::current_exception();
+        }
+
+        /* Stop taking checkpoints */
+        {
+            std::lock_guard<std::mutex> lock(checkpointMutex);
+            renderingDone = true;
+        }
+        checkpointCondition.notify_all();
     });
 
     /* Enter the application main loop */
-    nanogui::mainloop();
+    if (screen)
+        nanogui::mainloop();
 
     /* Shut down the user interface */
     render_thread.join();
+    if (checkpoint_thread.joinable())
+        checkpoint_thread.join();
 
-    delete screen;
-    nanogui::shutdown();
+    if (screen) {
+        delete screen;
+        nanogui::shutdown();
+    }
 
-    /* Now turn the rendered image block into
-       a properly normalized bitmap */
-    std::unique_ptr<Bitmap> bitmap(result.toBitmap());
+    if (renderError)
+        std::rethrow_exception(renderError);
 
-    /* Determine the filename of the output bitmap */
-    std::string outputName = filename;
-    size_t lastdot = outputName.find_last_of(".");
-    if (lastdot != std::string::npos)
-        outputName.erase(lastdot, std::string::npos);
+    for (View &view : views) {
+        if (options.partial) {
+            /* Save the unnormalized film, which will be merged with other
+               partial renderings of the same scene using '--merge' */
+            view.result->saveEXR(view.outputName);
+        } else {
+            /* Now turn the rendered image block into
+               a properly normalized bitmap */
+            std::unique_ptr<Bitmap> bitmap(view.result->toBitmap());
+
+            /* Normalize the AOVs, which become layers of the EXR file */
+            std::vector<std::unique_ptr<Bitmap>> aovBitmaps;
+            std::vector<std::pair<std::string, const Bitmap *>> layers;
+            if (view.aovs) {
+                for (size_t k=0; k<aovNames.size(); ++k) {
+                    aovBitmaps.emplace_back(view.aovs->films[k]->toBitmap());
+                    layers.push_back(std::make_pair(aovNames[k], aovBitmaps.back().get()));
+                }
+            }
 
-    /* Save using the OpenEXR format */
-    bitmap->saveEXR(outputName);
+            if (scene->getDenoiser()) {
+                /* Keep the noisy image around for comparison */
+                bitmap->saveEXR(view.outputName + "_noisy");
+
+                auto aov = [&](const std::string &name) -> const Bitmap & {
+                    size_t k = std::find(aovNames.begin(), aovNames.end(), name) - aovNames.begin();
+                    if (k >= aovBitmaps.size())
+                        throw NoriException("The denoiser requires the AOV \"%s\", which was not rendered!", name);
+                    return *aovBitmaps[k];
+                };
+
+                cout << "Denoising .. ";
+                cout.flush();
+                Timer timer;
+                NORI_TRACE_SCOPE("output", "Denoise");
+                scene->getDenoiser()->denoise(*bitmap, aov("albedo"), aov("normal"), aov("depth"));
+                cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            }
 
-    /* Save tonemapped (sRGB) output using the PNG format */
-    bitmap->savePNG(outputName);
+            /* Save using the OpenEXR format (including the AOVs) */
+            bitmap->saveEXR(view.outputName, layers);
+
+            /* Save tonemapped (sRGB) output using the PNG format */
+            bitmap->savePNG(view.outputName);
+        }
+
+        /* The rendering is complete, the checkpoint is no longer needed. Without
+           '--checkpoint' or '--resume', the file belongs to another run (if any) */
+        if (options.checkpointInterval > 0 || options.resume)
+            view.checkpoint->remove();
+    }
+}
+
+/// A scene that is kept in memory by the render server
+struct CachedScene {
+    std::unique_ptr<NoriObject> root;
+
+    /// Modification times of the scene file and of all files that were read while loading it
+    std::vector<std::pair<std::string, int64_t>> dependencies;
+
+    /// Has any of the files that make up the scene been modified since it was loaded?
+    bool isModified() const {
+        for (const auto &dep : dependencies) {
+            if (getFileModificationTime(dep.first) != dep.second)
+                return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * Create a copy of the camera of a scene file with modified properties. The
+ * camera is re-created from its XML description, so that all properties that
+ * are not overridden (including the reconstruction filter) stay the same.
+ */
+static Camera *createCamera(const std::string &sceneName,
+                            const std::map<std::string, std::string> &overrides) {
+    pugi::xml_document doc;
+    if (!doc.load_file(sceneName.c_str()))
+        throw NoriException("Unable to parse \"%s\"!", sceneName);
+    pugi::xml_node camera = doc.child("scene").child("camera");
+    if (!camera)
+        throw NoriException("\"%s\" does not contain a camera!", sceneName);
+
+    /* Replace or add a property of the camera */
+    auto setProperty = [&](const char *tag, const char *name, const std::string &value) {
+        pugi::xml_node node = camera.find_child_by_attribute(tag, "name", name);
+        if (!node) {
+            node = camera.prepend_child(tag);
+            node.append_attribute("name") = name;
+            node.append_attribute("value");
+        }
+        node.attribute("value") = value.c_str();
+    };
+
+    const char *integerProperties[] = { "width", "height" };
+    for (const char *name : integerProperties) {
+        if (overrides.count(name))
+            setProperty("integer", name, overrides.at(name));
+    }
+    if (overrides.count("fov"))
+        setProperty("float", "fov", overrides.at("fov"));
+
+    if (overrides.count("origin") || overrides.count("target") || overrides.count("up")) {
+        if (!overrides.count("origin") || !overrides.count("target") || !overrides.count("up"))
+            throw NoriException("Camera overrides must specify all of 'origin', 'target' and 'up'!");
+        pugi::xml_node toWorld = camera.find_child_by_attribute("transform", "name", "toWorld");
+        if (toWorld)
+            camera.remove_child(toWorld);
+        toWorld = camera.prepend_child("transform");
+        toWorld.append_attribute("name") = "toWorld";
+        pugi::xml_node lookAt = toWorld.append_child("lookat");
+        for (const char *name : { "origin", "target", "up" })
+            lookAt.append_attribute(name) = overrides.at(name).c_str();
+    }
+
+    std::ostringstream os;
+    camera.print(os);
+    return static_cast<Camera *>(loadFromXMLString(os.str(), sceneName));
+}
+
+/**
+ * Persistent render server: reads rendering requests from standard input
+ * (one per line) and keeps parsed scenes, meshes and acceleration data
+ * structures in memory between requests. Syntax of a request:
+ *
+ *   render <scene.xml> [key=value ...]
+ *   quit
+ *
+ * Supported keys: output, spp, crop (x,y,w,h), passes (begin,end), partial,
+ * progress (interval in seconds between "progress key=value ..." lines),
+ * and the camera overrides width, height, fov, origin, target and up (the
+ * last three are vectors of the form x,y,z). Every request is answered by a
+ * line starting with either "ok" or "error".
+ *
+ * Only these protocol lines are written to standard output. All other
+ * messages (log output of the loading and rendering) go to standard error.
+ *
+ * A cached scene is reused as long as neither the scene file nor any of the
+ * files it reads (meshes, textures and their mip maps, environment maps) has
+ * changed. Otherwise, the entire scene is loaded again -- there is no reload
+ * of individual objects. Unchanged meshes are still taken from the OBJ cache,
+ * but all other objects and the acceleration data structure are rebuilt.
+ */
+static void serve() {
+    std::map<std::string, CachedScene> cache;
+
+    /* Unchanged OBJ files don't need to be parsed again when a modified scene is reloaded */
+    setOBJCacheEnabled(true);
+
+    /* Keep standard output free of log messages */
+    std::ostream protocol(cout.rdbuf());
+    std::streambuf *coutBuffer = cout.rdbuf(cerr.rdbuf());
+
+    cout << "Nori render server ready" << endl;
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::vector<std::string> tokens = tokenize(line, " \t");
+        if (tokens.empty())
+            continue;
+        if (tokens[0] == "quit")
+            break;
+
+        try {
+            if (tokens[0] != "render" || tokens.size() < 2)
+                throw NoriException("Invalid request \"%s\"", line);
+
+            std::string sceneName = tokens[1];
+            std::map<std::string, std::string> args;
+            for (size_t i=2; i<tokens.size(); ++i) {
+                size_t pos = tokens[i].find('=');
+                if (pos == std::string::npos)
+                    throw NoriException("Invalid argument \"%s\"", tokens[i]);
+                args[tokens[i].substr(0, pos)] = tokens[i].substr(pos + 1);
+            }
+
+            /* Validate all arguments before anything is loaded or modified */
+            static const char *cameraKeys[] = { "width", "height", "fov", "origin", "target", "up" };
+            for (const auto &kv : args) {
+                static const char *otherKeys[] = { "output", "spp", "crop", "passes", "partial", "progress" };
+                auto isKey = [&](const char *key) { return kv.first == key; };
+                if (std::none_of(std::begin(cameraKeys), std::end(cameraKeys), isKey) &&
+                    std::none_of(std::begin(otherKeys), std::end(otherKeys), isKey))
+                    throw NoriException("Unknown argument \"%s\"", kv.first);
+            }
+
+            RenderOptions options;
+            options.gui = false;
+            options.outputName = args.count("output") ? args["output"] : std::string();
+            options.partial = args.count("partial") && toBool(args["partial"]);
+            if (args.count("progress")) {
+                options.progressInterval = toFloat(args["progress"]);
+                options.progressFormat = RenderProgress::EMachine;
+                options.progressStream = &protocol;
+            }
+            if (args.count("crop")) {
+                std::vector<std::string> crop = tokenize(args["crop"], ",");
+                if (crop.size() != 4)
+                    throw NoriException("Invalid crop window \"%s\"", args["crop"]);
+                options.cropOffset = Point2i(toInt(crop[0]), toInt(crop[1]));
+                options.cropSize = Vector2i(toInt(crop[2]), toInt(crop[3]));
+            }
+            if (args.count("passes")) {
+                std::vector<std::string> passes = tokenize(args["passes"], ",");
+                if (passes.size() != 2 || toUInt(passes[0]) >= toUInt(passes[1]))
+                    throw NoriException("Invalid pass range \"%s\"", args["passes"]);
+                options.passBegin = toUInt(passes[0]);
+                options.passEnd = toUInt(passes[1]);
+            }
+            uint32_t sampleCountOverride = 0;
+            if (args.count("spp")) {
+                sampleCountOverride = toUInt(args["spp"]);
+                if (sampleCountOverride == 0 || args["spp"][0] == '-')
+                    throw NoriException("Invalid sample count \"%s\"", args["spp"]);
+            }
+
+            /* Create the overridden camera (which replaces all views of the scene) */
+            std::unique_ptr<Camera> camera;
+            for (const char *name : cameraKeys) {
+                if (args.count(name)) {
+                    std::map<std::string, std::string> overrides(args);
+                    for (auto &kv : overrides)
+                        std::replace(kv.second.begin(), kv.second.end(), ',', ' ');
+                    camera.reset(createCamera(sceneName, overrides));
+                    break;
+                }
+            }
+
+            /* Load the scene, unless an unmodified copy is already in memory */
+            CachedScene &entry = cache[sceneName];
+            if (!entry.root || entry.isModified()) {
+                entry = CachedScene();
+
+                filesystem::path path(sceneName);
+                getFileResolver()->prepend(path.parent_path());
+                startFileDependencyRecording();
+                try {
+                    entry.root.reset(loadFromXML(sceneName));
+                } catch (...) {
+                    stopFileDependencyRecording();
+                    getFileResolver()->erase(getFileResolver()->begin());
+                    cache.erase(sceneName);
+                    throw;
+                }
+                std::vector<std::string> dependencies = stopFileDependencyRecording();
+                getFileResolver()->erase(getFileResolver()->begin());
+
+                if (entry.root->getClassType() != NoriObject::EScene) {
+                    cache.erase(sceneName);
+                    throw NoriException("\"%s\" does not describe a scene!", sceneName);
+                }
+
+                dependencies.insert(dependencies.begin(), sceneName);
+                for (const std::string &filename : dependencies)
+                    entry.dependencies.push_back(std::make_pair(
+                        filename, getFileModificationTime(filename)));
+            } else {
+                cout << "Using cached scene \"" << sceneName << "\"" << endl;
+            }
+
+            Scene *scene = static_cast<Scene *>(entry.root.get());
+
+            /* Temporarily apply the camera and sample count overrides. The cached
+               scene is restored no matter whether the rendering succeeds */
+            std::vector<Camera *> cameras;
+            bool cameraOverridden = false;
+            size_t sampleCount = scene->getSampler()->getSampleCount();
+            auto restore = [&] {
+                scene->getSampler()->setSampleCount(sampleCount);
+                if (!cameraOverridden)
+                    return;
+                for (Camera *camera : scene->setCameras(cameras))
+                    delete camera;
+                cameraOverridden = false;
+            };
+
+            Timer timer;
+            try {
+                if (camera) {
+                    cameras = scene->setCameras({ camera.get() });
+                    camera.release();
+                    cameraOverridden = true;
+                }
+                if (sampleCountOverride > 0)
+                    scene->getSampler()->setSampleCount(sampleCountOverride);
+                render(scene, sceneName, options);
+            } catch (...) {
+                restore();
+                throw;
+            }
+            restore();
+
+            protocol << "ok " << timer.elapsed() / 1000.0 << endl;
+        } catch (const std::exception &e) {
+            protocol << "error " << e.what() << endl;
+        }
+    }
+
+    cout.rdbuf(coutBuffer);
+    setOBJCacheEnabled(false);
 }
 
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        cerr << "Syntax: " << argv[0] << " <scene.xml>" << endl;
+    RenderOptions options;
+    std::string sceneName, mergeName;
+    std::vector<std::string> mergeFiles;
+    bool valid = true, server = false;
+
+    for (int i=1; i<argc && valid; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--resume") {
+            options.resume = true;
+        } else if (arg == "--checkpoint" && i+1 < argc) {
+            options.checkpointInterval = toFloat(argv[++i]);
+        } else if (arg == "--no-gui") {
+            options.gui = false;
+        } else if (arg == "--crop" && i+4 < argc) {
+            options.cropOffset = Point2i(toInt(argv[i+1]), toInt(argv[i+2]));
+            options.cropSize = Vector2i(toInt(argv[i+3]), toInt(argv[i+4]));
+            i += 4;
+        } else if (arg == "--passes" && i+2 < argc) {
+            options.passBegin = toUInt(argv[i+1]);
+            options.passEnd = toUInt(argv[i+2]);
+            valid = options.passBegin < options.passEnd;
+            i += 2;
+        } else if (arg == "--output" && i+1 < argc) {
+            options.outputName = argv[++i];
+        } else if (arg == "--partial") {
+            options.partial = true;
+        } else if (arg == "--convergence" && i+1 < argc) {
+            options.referenceName = argv[++i];
+        } else if (arg == "--trace" && i+1 < argc) {
+            options.traceName = argv[++i];
+        } else if (arg == "--progress" && i+1 < argc) {
+            options.progressInterval = toFloat(argv[++i]);
+        } else if (arg == "--machine-progress") {
+            options.progressFormat = RenderProgress::EMachine;
+        } else if (arg == "--texture-cache" && i+1 < argc) {
+            /* The tile cache is shared by all scenes that the process loads */
+            TextureCache::getInstance()->setMemoryLimit((size_t) toUInt(argv[++i]) * 1024 * 1024);
+        } else if (arg == "--server") {
+            server = true;
+        } else if (arg == "--merge" && i+2 < argc) {
+            mergeName = argv[++i];
+            while (i+1 < argc)
+                mergeFiles.push_back(argv[++i]);
+        } else if (sceneName.empty() && arg.compare(0, 2, "--") != 0) {
+            sceneName = arg;
+        } else {
+            valid = false;
+        }
+    }
+
+    if (!valid || (!server && sceneName.empty() == mergeName.empty())) {
+        cerr << "Syntax: " << argv[0] << " [options] <scene.xml>" << endl
+             << "        " << argv[0] << " <image.exr>" << endl
+             << "        " << argv[0] << " --merge <output> <partial1.exr> <partial2.exr> ..." << endl
+             << "        " << argv[0] << " --server" << endl
+             << "Options:" << endl
+             << "   --checkpoint <seconds>  Periodically save a checkpoint of the rendering" << endl
+             << "   --resume                Resume from a previously saved checkpoint" << endl
+             << "   --no-gui                Render without opening a preview window" << endl
+             << "   --crop <x> <y> <w> <h>  Only render the specified crop window" << endl
+             << "   --passes <begin> <end>  Only render passes begin, ..., end-1 (default: 0 1)" << endl
+             << "   --output <name>         Base name of the output files" << endl
+             << "   --partial               Save the unnormalized film for a later '--merge'" << endl
+             << "   --convergence <ref.exr> Record the error after every pass in <output>_convergence.csv" << endl
+             << "   --trace <trace.json>    Record a timeline of the rendering in the Chrome trace format" << endl
+             << "   --progress <seconds>    Print the progress, throughput and ETA at this interval" << endl
+             << "   --machine-progress      Print the progress as 'progress key=value ...' lines" << endl
+             << "   --texture-cache <MiB>   Memory budget of the texture tile cache (default: 256)" << endl;
         return -1;
     }
 
-    filesystem::path path(argv[1]);
+    if (server || !mergeName.empty()) {
+        try {
+            if (server)
+                serve();
+            else
+                merge(mergeName, mergeFiles);
+        } catch (const std::exception &e) {
+            cerr << "Fatal error: " << e.what() << endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    filesystem::path path(sceneName);
+    if (!options.traceName.empty())
+        Trace::enable();
 
     try {
         if (path.extension() == "xml") {
@@ -162,14 +972,14 @@ int main(int argc, char **argv) {
                resources (OBJ files, textures) using relative paths */
             getFileResolver()->prepend(path.parent_path());
 
-            std::unique_ptr<NoriObject> root(loadFromXML(argv[1]));
+            std::unique_ptr<NoriObject> root(loadFromXML(sceneName));
 
             /* When the XML root object is a scene, start rendering it .. */
             if (root->getClassType() == NoriObject::EScene)
-                render(static_cast<Scene *>(root.get()), argv[1]);
+                render(static_cast<Scene *>(root.get()), sceneName, options);
         } else if (path.extension() == "exr") {
             /* Alternatively, provide a basic OpenEXR image viewer */
-            Bitmap bitmap(argv[1]);
+            Bitmap bitmap(sceneName);
             ImageBlock block(Vector2i((int) bitmap.cols(), (int) bitmap.rows()), nullptr);
             block.fromBitmap(bitmap);
             nanogui::init();
@@ -178,12 +988,21 @@ int main(int argc, char **argv) {
             delete screen;
             nanogui::shutdown();
         } else {
-            cerr << "Fatal error: unknown file \"" << argv[1]
+            cerr << "Fatal error: unknown file \"" << sceneName
                  << "\", expected an extension of type .xml or .exr" << endl;
         }
     } catch (const std::exception &e) {
         cerr << "Fatal error: " << e.what() << endl;
         return -1;
     }
+
+    if (!options.traceName.empty()) {
+        try {
+            Trace::save(options.traceName);
+        } catch (const std::exception &e) {
+            cerr << "Fatal error: " << e.what() << endl;
+            return -1;
+        }
+    }
     return 0;
 }
@@ -25,6 +25,8 @@
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_COUNTER(statEmitterSamples, "Emitters", "Emitter samples");
+
 Mesh::Mesh() 
 {
 }
@@ -155,6 +157,85 @@ std::string Mesh::toString() const {
     );
 }
 
+void HitRecord::computeIntersection(Intersection &its) const {
+    its.t = t;
+    its.mesh = mesh;
+
+    /* Find the barycentric coordinates */
+    Vector3f b;
+    b << 1 - bary.sum(), bary;
+
+    /* References to all relevant mesh buffers */
+    const MatrixXf &V  = mesh->getVertexPositions();
+    const MatrixXf &N  = mesh->getVertexNormals();
+    const MatrixXf &UV = mesh->getVertexTexCoords();
+    const MatrixXu &F  = mesh->getIndices();
+
+    /* Vertex indices of the triangle */
+    uint32_t idx0 = F(0, triangle), idx1 = F(1, triangle), idx2 = F(2, triangle);
+
+    Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
+
+    /* Compute the intersection positon accurately
+       using barycentric coordinates */
+    its.p = b.x() * p0 + b.y() * p1 + b.z() * p2;
+
+    /* Compute proper texture coordinates if provided by the mesh */
+    if (UV.size() > 0)
+        its.uv = b.x() * UV.col(idx0) +
+                 b.y() * UV.col(idx1) +
+                 b.z() * UV.col(idx2);
+    else
+        its.uv = bary;
+
+    /* Compute the geometry frame */
+    its.geoFrame = Frame((p1 - p0).cross(p2 - p0).normalized());
+
+    if (N.size() > 0) {
+        /* Compute the shading frame. Note that for simplicity,
+           the current implementation doesn't attempt to provide
+           tangents that are continuous across the surface. That
+           means that this code will need to be modified to be able
+           use anisotropic BRDFs, which need tangent continuity */
+
+        its.shFrame = Frame(
+            (b.x() * N.col(idx0) +
+             b.y() * N.col(idx1) +
+             b.z() * N.col(idx2)).normalized());
+    } else {
+        its.shFrame = its.geoFrame;
+    }
+}
+
+float HitRecord::computeUVWidth(const Ray3f &ray, const Intersection &its) const {
+    if (ray.spread <= 0)
+        return 0.0f;
+
+    const MatrixXf &V  = mesh->getVertexPositions();
+    const MatrixXf &UV = mesh->getVertexTexCoords();
+    const MatrixXu &F  = mesh->getIndices();
+    uint32_t idx0 = F(0, triangle), idx1 = F(1, triangle), idx2 = F(2, triangle);
+
+    Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
+    float area = (p1 - p0).cross(p2 - p0).norm();
+    if (area == 0)
+        return 0.0f;
+
+    /* Without texture coordinates, the barycentric coordinates are used instead */
+    float uvArea = 1.0f;
+    if (UV.size() > 0) {
+        Vector2f e1 = UV.col(idx1) - UV.col(idx0), e2 = UV.col(idx2) - UV.col(idx0);
+        uvArea = std::abs(e1.x() * e2.y() - e1.y() * e2.x());
+    }
+
+    /* Width of the cone at the intersection, stretched by oblique incidence */
+    float norm = ray.d.norm();
+    float cosTheta = std::max(std::abs(its.geoFrame.n.dot(ray.d)) / norm, 1e-4f);
+    float width = ray.spread * its.t * norm / cosTheta;
+
+    return width * std::sqrt(uvArea / area);
+}
+
 std::string Intersection::toString() const {
     if (!mesh)
         return "Intersection[invalid]";
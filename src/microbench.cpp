@@ -0,0 +1,342 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/mesh.h>
+#include <nori/bbox.h>
+#include <nori/bsdf.h>
+#include <nori/block.h>
+#include <nori/rfilter.h>
+#include <nori/dpdf.h>
+#include <nori/frame.h>
+#include <nori/warp.h>
+#include <nori/timer.h>
+#include <Eigen/Geometry>
+#include <pcg32.h>
+#include <memory>
+
+/* Microbenchmarks of individual geometry and sampling primitives
+
+   Every kernel is run on a table of precomputed random inputs. The number
+   of iterations per run is first doubled until a run takes long enough
+   to be timed accurately (which also warms up the caches and the branch
+   predictors). Afterwards, the kernel is run repeatedly and the median,
+   minimum and standard deviation of the time per operation are reported.
+
+   Each kernel accumulates its results into a checksum that is written to
+   a volatile variable, so that the compiler cannot discard the work. */
+
+NORI_NAMESPACE_BEGIN
+
+/// Number of precomputed inputs per kernel (a power of two)
+static const size_t InputCount = 4096;
+
+/// Sink for the checksums of the kernels
+static volatile float checksumSink = 0.0f;
+
+class MicroBenchmark {
+public:
+    MicroBenchmark(int repeats, double minTime, const std::string &filter)
+        : m_repeats(repeats), m_minTime(minTime), m_filter(filter) { }
+
+    /**
+     * \brief Measure the time per operation of a kernel
+     *
+     * \param func
+     *    Function that performs the given number of operations
+     *    and returns a checksum of their results
+     */
+    template <typename Func> void run(const std::string &name, const Func &func) {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+            return;
+
+        /* Calibration and warm-up */
+        size_t iterations = 1;
+        while (true) {
+            Timer timer;
+            checksumSink = checksumSink + func(iterations);
+            if (timer.elapsed() >= m_minTime)
+                break;
+            iterations *= 2;
+        }
+
+        std::vector<double> times(m_repeats);
+        for (int i = 0; i < m_repeats; ++i) {
+            Timer timer;
+            checksumSink = checksumSink + func(iterations);
+            times[i] = timer.elapsed() * 1e6 / iterations;
+        }
+
+        std::sort(times.begin(), times.end());
+        double mean = 0, variance = 0;
+        for (double time : times)
+            mean += time;
+        mean /= m_repeats;
+        for (double time : times)
+            variance += (time - mean) * (time - mean);
+        variance /= std::max(m_repeats - 1, 1);
+
+        cout << tfm::format("%-44s %10.2f %10.2f %9.1f%% %12zu", name,
+            times[m_repeats / 2], times[0], 100 * std::sqrt(variance) / mean,
+            iterations) << endl;
+    }
+
+    void printHeader() const {
+        cout << tfm::format("%-44s %10s %10s %10s %12s", "Kernel",
+            "ns/op", "min", "stddev", "ops/run") << endl;
+    }
+
+private:
+    int m_repeats;
+    double m_minTime;
+    std::string m_filter;
+};
+
+/// Triangle soup that is used to benchmark ray-triangle intersections
+class BenchmarkMesh : public Mesh {
+public:
+    BenchmarkMesh(pcg32 &rng, uint32_t triangleCount) {
+        m_V.resize(3, 3 * triangleCount);
+        m_F.resize(3, triangleCount);
+        for (uint32_t i = 0; i < triangleCount; ++i) {
+            Point3f center(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+            for (uint32_t j = 0; j < 3; ++j) {
+                Point3f p = center + 0.1f * Vector3f(rng.nextFloat() - 0.5f,
+                    rng.nextFloat() - 0.5f, rng.nextFloat() - 0.5f);
+                m_V.col(3 * i + j) = p;
+                m_F(j, i) = 3 * i + j;
+                m_bbox.expandBy(p);
+            }
+        }
+        m_name = "benchmark mesh";
+    }
+};
+
+static Point2f nextPoint2f(pcg32 &rng) {
+    return Point2f(rng.nextFloat(), rng.nextFloat());
+}
+
+static Vector3f nextDirection(pcg32 &rng) {
+    return Warp::squareToUniformSphere(nextPoint2f(rng));
+}
+
+static void benchmarkGeometry(MicroBenchmark &bench, pcg32 &rng) {
+    /* Rays from outside of the unit cube towards random points inside of it */
+    std::vector<Ray3f> rays(InputCount);
+    for (Ray3f &ray : rays) {
+        Point3f target(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+        Point3f origin = Point3f(0.5f) + 2.0f * nextDirection(rng);
+        ray = Ray3f(origin, (target - origin).normalized());
+    }
+
+    BenchmarkMesh mesh(rng, InputCount);
+    bench.run("Mesh::rayIntersect", [&](size_t n) {
+        float checksum = 0, u, v, t;
+        for (size_t i = 0; i < n; ++i) {
+            if (mesh.rayIntersect((uint32_t) (i % InputCount), rays[(i * 7) % InputCount], u, v, t))
+                checksum += t;
+        }
+        return checksum;
+    });
+
+    std::vector<BoundingBox3f> boxes(InputCount);
+    for (BoundingBox3f &box : boxes) {
+        Point3f p(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+        box = BoundingBox3f(p, p + 0.2f * Vector3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat()));
+    }
+
+    bench.run("BoundingBox3f::rayIntersect", [&](size_t n) {
+        float checksum = 0;
+        for (size_t i = 0; i < n; ++i)
+            checksum += boxes[i % InputCount].rayIntersect(rays[(i * 7) % InputCount]) ? 1.0f : 0.0f;
+        return checksum;
+    });
+
+    bench.run("BoundingBox3f::rayIntersect (near/far)", [&](size_t n) {
+        float checksum = 0, nearT, farT;
+        for (size_t i = 0; i < n; ++i) {
+            if (boxes[i % InputCount].rayIntersect(rays[(i * 7) % InputCount], nearT, farT))
+                checksum += nearT;
+        }
+        return checksum;
+    });
+
+    std::vector<Frame> frames(InputCount);
+    std::vector<Vector3f> directions(InputCount);
+    for (size_t i = 0; i < InputCount; ++i) {
+        frames[i] = Frame(nextDirection(rng));
+        directions[i] = nextDirection(rng);
+    }
+
+    bench.run("Frame::toLocal", [&](size_t n) {
+        float checksum = 0;
+        for (size_t i = 0; i < n; ++i)
+            checksum += frames[i % InputCount].toLocal(directions[(i * 7) % InputCount]).z();
+        return checksum;
+    });
+}
+
+static void benchmarkSampling(MicroBenchmark &bench, pcg32 &rng) {
+    std::vector<Point2f> samples(InputCount);
+    std::vector<Vector3f> directions(InputCount);
+    for (size_t i = 0; i < InputCount; ++i) {
+        samples[i] = nextPoint2f(rng);
+        directions[i] = Warp::squareToCosineHemisphere(nextPoint2f(rng));
+    }
+
+    /* Benchmark a warping function that maps to 2D or 3D points */
+    auto warp = [&](const char *name, const auto &func) {
+        bench.run(name, [&](size_t n) {
+            float checksum = 0;
+            for (size_t i = 0; i < n; ++i)
+                checksum += func(i % InputCount).x();
+            return checksum;
+        });
+    };
+
+    warp("Warp::squareToUniformSquare", [&](size_t i) { return Warp::squareToUniformSquare(samples[i]); });
+    warp("Warp::squareToTent", [&](size_t i) { return Warp::squareToTent(samples[i]); });
+    warp("Warp::squareToUniformDisk", [&](size_t i) { return Warp::squareToUniformDisk(samples[i]); });
+    warp("Warp::squareToUniformSphere", [&](size_t i) { return Warp::squareToUniformSphere(samples[i]); });
+    warp("Warp::squareToUniformHemisphere", [&](size_t i) { return Warp::squareToUniformHemisphere(samples[i]); });
+    warp("Warp::squareToCosineHemisphere", [&](size_t i) { return Warp::squareToCosineHemisphere(samples[i]); });
+    warp("Warp::squareToBeckmann", [&](size_t i) { return Warp::squareToBeckmann(samples[i], 0.3f); });
+    warp("Warp::squareToBeckmannVisible", [&](size_t i) {
+        return Warp::squareToBeckmannVisible(samples[i], directions[i], 0.3f);
+    });
+
+    DiscretePDF dpdf(1024);
+    for (size_t i = 0; i < 1024; ++i)
+        dpdf.append(rng.nextFloat());
+    dpdf.normalize();
+
+    bench.run("DiscretePDF::sample (1024 entries)", [&](size_t n) {
+        float checksum = 0;
+        for (size_t i = 0; i < n; ++i)
+            checksum += (float) dpdf.sample(samples[i % InputCount].x());
+        return checksum;
+    });
+}
+
+static void benchmarkBSDFs(MicroBenchmark &bench, pcg32 &rng) {
+    std::vector<Point2f> samples(InputCount);
+    std::vector<Vector3f> wi(InputCount), wo(InputCount);
+    for (size_t i = 0; i < InputCount; ++i) {
+        samples[i] = nextPoint2f(rng);
+        wi[i] = Warp::squareToCosineHemisphere(nextPoint2f(rng));
+        wo[i] = Warp::squareToCosineHemisphere(nextPoint2f(rng));
+    }
+
+    /* Instantiate every registered BSDF that can be created with default parameters */
+    for (const std::string &name : NoriObjectFactory::getClassNames()) {
+        std::unique_ptr<NoriObject> object;
+        try {
+            object.reset(NoriObjectFactory::createInstance(name, PropertyList()));
+            if (object->getClassType() != NoriObject::EBSDF)
+                continue;
+            object->activate();
+        } catch (const std::exception &) {
+            continue;
+        }
+        const BSDF *bsdf = static_cast<const BSDF *>(object.get());
+
+        BSDFQueryRecord bRec(Vector3f(0.0f, 0.0f, 1.0f));
+        bRec.its.uv = Point2f(0.5f);
+
+        bench.run(tfm::format("BSDF::sample (%s)", name), [&](size_t n) {
+            float checksum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                bRec.wi = wi[i % InputCount];
+                checksum += bsdf->sample(bRec, samples[(i * 7) % InputCount]).r();
+            }
+            return checksum;
+        });
+
+        bench.run(tfm::format("BSDF::eval (%s)", name), [&](size_t n) {
+            float checksum = 0;
+            bRec.measure = ESolidAngle;
+            for (size_t i = 0; i < n; ++i) {
+                bRec.wi = wi[i % InputCount];
+                bRec.wo = wo[(i * 7) % InputCount];
+                checksum += bsdf->eval(bRec).r();
+            }
+            return checksum;
+        });
+    }
+}
+
+static void benchmarkImageBlock(MicroBenchmark &bench, pcg32 &rng) {
+    std::vector<Point2f> positions(InputCount);
+    std::vector<Color3f> values(InputCount);
+    for (size_t i = 0; i < InputCount; ++i) {
+        positions[i] = Point2f(rng.nextFloat() * 32, rng.nextFloat() * 32);
+        values[i] = Color3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+    }
+
+    for (const char *filterName : { "gaussian", "box" }) {
+        std::unique_ptr<ReconstructionFilter> filter(static_cast<ReconstructionFilter *>(
+            NoriObjectFactory::createInstance(filterName, PropertyList())));
+        ImageBlock block(Vector2i(32), filter.get());
+        block.clear();
+
+        bench.run(tfm::format("ImageBlock::put (%s)", filterName), [&](size_t n) {
+            for (size_t i = 0; i < n; ++i)
+                block.put(positions[i % InputCount], values[(i * 7) % InputCount]);
+            return block(0, 0).x();
+        });
+    }
+}
+
+NORI_NAMESPACE_END
+
+int main(int argc, char **argv) {
+    using namespace nori;
+
+    int repeats = 15;
+    double minTime = 10.0;
+    std::string filter;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "--repeats" && i + 1 < argc) {
+                repeats = std::max(toInt(argv[++i]), 1);
+            } else if (arg == "--min-time" && i + 1 < argc) {
+                minTime = toFloat(argv[++i]);
+            } else if (arg.compare(0, 2, "--") != 0 && filter.empty()) {
+                filter = arg;
+            } else {
+                cerr << "Syntax: " << argv[0] << " [--repeats N] [--min-time ms] [kernel name filter]" << endl;
+                return -1;
+            }
+        }
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return -1;
+    }
+
+    MicroBenchmark bench(repeats, minTime, filter);
+    pcg32 rng;
+
+    bench.printHeader();
+    benchmarkGeometry(bench, rng);
+    benchmarkSampling(bench, rng);
+    benchmarkBSDFs(bench, rng);
+    benchmarkImageBlock(bench, rng);
+
+    return 0;
+}
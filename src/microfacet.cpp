@@ -19,9 +19,13 @@
 #include <nori/bsdf.h>
 #include <nori/frame.h>
 #include <nori/warp.h>
+#include <nori/texture.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_COUNTER(statMicrofacetSamples, "BSDF samples", "microfacet");
+
 class Microfacet : public BSDF {
 public:
 	Microfacet(const PropertyList &propList) {
@@ -46,6 +50,34 @@ public:
 		   interested in implementing a more realistic version
 		   of this BRDF. */
 		m_ks = 1 - m_kd.maxCoeff();
+
+		/* Only sample microfacet normals that are visible from the
+		   incident direction? (fewer wasted samples at grazing angles) */
+		m_sampleVisible = propList.getBoolean("sampleVisible", false);
+	}
+
+	virtual ~Microfacet() {
+		delete m_kdTexture;
+		delete m_alphaTexture;
+	}
+
+	/// Return the roughness at the surface position associated with a query
+	float evalAlpha(const BSDFQueryRecord &bRec) const {
+		if (m_alphaTexture && bRec.its.mesh)
+			return std::max(m_alphaTexture->eval(bRec.its.uv, bRec.its.uvWidth).mean(), 1e-4f);
+		return m_alpha;
+	}
+
+	/// Return the diffuse albedo at the surface position associated with a query
+	Color3f evalKd(const BSDFQueryRecord &bRec) const {
+		if (m_kdTexture && bRec.its.mesh)
+			return m_kdTexture->eval(bRec.its.uv, bRec.its.uvWidth);
+		return m_kd;
+	}
+
+	Color3f getAlbedo(const Intersection &its) const {
+		Color3f kd = m_kdTexture ? m_kdTexture->eval(its.uv, its.uvWidth) : m_kd;
+		return kd + Color3f(1 - kd.maxCoeff());
 	}
 
 	float CHIPlus(const float c) const
@@ -84,6 +116,11 @@ public:
 			|| Frame::cosTheta(bRec.wo) <= 0)
 			return Color3f(0.0f);
 
+		/* Look up the (possibly textured) parameters */
+		float alpha = evalAlpha(bRec);
+		Color3f kd = evalKd(bRec);
+		float ks = 1 - kd.maxCoeff();
+
 		Vector3f wh = ((bRec.wi + bRec.wo)*0.5).normalized();
 
 		float cosThetai = Frame::cosTheta(bRec.wi);
@@ -114,19 +151,19 @@ public:
 
 		
 		//compute the Beckman term
-		float d = Warp::squareToBeckmannPdf(wh, m_alpha);
+		float d = Warp::squareToBeckmannPdf(wh, alpha);
 		
 		//compute the Fresnel term
 		float f = fresnel(wh.dot(bRec.wi), m_extIOR, m_intIOR);
 
 		//compute the geometry term
-		float g = G(m_alpha, bRec.wi, bRec.wo, wh);
+		float g = G(alpha, bRec.wi, bRec.wo, wh);
 		//G = G1(bRec.wi, wh) * G1(bRec.wo, wh);
 
 
 		
 
-		return (m_kd * INV_PI) +(m_ks * ((d * f * g) / (4.0f * cosThetai * cosThetao * Frame::cosTheta(wh))));
+		return (kd * INV_PI) +(ks * ((d * f * g) / (4.0f * cosThetai * cosThetao * Frame::cosTheta(wh))));
 		
     }
 
@@ -138,19 +175,26 @@ public:
 			|| Frame::cosTheta(bRec.wo) <= 0)
 			return 0.0f;
 
+		/* Look up the (possibly textured) parameters */
+		float alpha = evalAlpha(bRec);
+		Color3f kd = evalKd(bRec);
+		float ks = 1 - kd.maxCoeff();
+
 		Vector3f wh = (bRec.wi + bRec.wo).normalized();
 
 		//compute the Beckman term devided by another cosine
 		//float D = Warp::squareToBeckmannPdf(wh, m_alpha) / Frame::cosTheta(wh);
-		float d = Warp::squareToBeckmannPdf(wh, m_alpha);
+		float d = m_sampleVisible
+			? Warp::squareToBeckmannVisiblePdf(wh, bRec.wi, alpha)
+			: Warp::squareToBeckmannPdf(wh, alpha);
 
 		float cosThetao = Frame::cosTheta(bRec.wo);
 
 		//Jacobian of the half direction mapping
 		float J = 1.0f / (4.0f * (wh.dot(bRec.wo)));
 
-		float term1 = m_ks * d  * J;
-		float term2 = (1.0f - m_ks) * cosThetao * INV_PI;
+		float term1 = ks * d  * J;
+		float term2 = (1.0f - ks) * cosThetao * INV_PI;
 
 		return term1 + term2;
 
@@ -169,29 +213,38 @@ public:
     /// Sample the BRDF
     Color3f sample(BSDFQueryRecord &bRec, const Point2f &_sample) const 
 	{
-	/*	if (Frame::cosTheta(bRec.wi) <= 0)
+		NORI_STAT_ADD(statMicrofacetSamples, 1);
+		if (Frame::cosTheta(bRec.wi) <= 0)
 			return Color3f(0.0f);
-*/
+
+		/* Look up the (possibly textured) parameters */
+		float alpha = evalAlpha(bRec);
+		Color3f kd = evalKd(bRec);
+		float ks = 1 - kd.maxCoeff();
+
 		bRec.measure = ESolidAngle;
 		/* Warp a uniformly distributed sample on [0,1]^2
 		to a direction on a cosine-weighted hemisphere */
-		if (_sample.x() < m_ks) 
+		if (_sample.x() < ks) 
 		{
-			float x = _sample.x() / m_ks;
+			float x = _sample.x() / ks;
 
-			Vector3f n = Warp::squareToBeckmann(Point2f(x, _sample.y()), m_alpha);
+			Vector3f n = m_sampleVisible
+				? Warp::squareToBeckmannVisible(Point2f(x, _sample.y()), bRec.wi, alpha)
+				: Warp::squareToBeckmann(Point2f(x, _sample.y()), alpha);
 
 			//wr = ¹ in local, n = ¹ normal in local
 
 			//Vector3f d = bRec.wi;
 			//Vector3f r = d - 2.f*(d.dot(n))*n;
 
-			bRec.wo = Warp::squareToBeckmann(Point2f(x, _sample.y()), m_alpha);
+			/* Reflect the incident direction at the sampled microfacet */
+			bRec.wo = 2.0f * bRec.wi.dot(n) * n - bRec.wi;
 		}
 		else 
 		{
 			
-			float x = (_sample.x() - m_ks) / (1.0f - m_ks);
+			float x = (_sample.x() - ks) / (1.0f - ks);
 
 
 			bRec.wo = Warp::squareToCosineHemisphere(Point2f(x, _sample.y()));
@@ -212,6 +265,25 @@ public:
 
     }
 
+    void addChild(NoriObject *obj) {
+        if (obj->getClassType() != ETexture)
+            throw NoriException("Microfacet::addChild(<%s>) is not supported!",
+                classTypeName(obj->getClassType()));
+
+        Texture *texture = static_cast<Texture *>(obj);
+        Texture **target = nullptr;
+        if (texture->getName() == "kd")
+            target = &m_kdTexture;
+        else if (texture->getName() == "alpha")
+            target = &m_alphaTexture;
+        else
+            throw NoriException("Microfacet: unsupported texture parameter \"%s\"!", texture->getName());
+
+        if (*target)
+            throw NoriException("Microfacet: tried to register multiple \"%s\" textures!", texture->getName());
+        *target = texture;
+    }
+
     bool isDiffuse() const {
         /* While microfacet BRDFs are not perfectly diffuse, they can be
            handled by sampling techniques for diffuse/non-specular materials,
@@ -226,13 +298,15 @@ public:
             "  intIOR = %f,\n"
             "  extIOR = %f,\n"
             "  kd = %s,\n"
-            "  ks = %f\n"
+            "  ks = %f,\n"
+            "  sampleVisible = %s\n"
             "]",
             m_alpha,
             m_intIOR,
             m_extIOR,
             m_kd.toString(),
-            m_ks
+            m_ks,
+            m_sampleVisible ? "true" : "false"
         );
     }
 private:
@@ -240,6 +314,9 @@ private:
     float m_intIOR, m_extIOR;
     float m_ks;
     Color3f m_kd;
+    bool m_sampleVisible;
+    Texture *m_kdTexture = nullptr;
+    Texture *m_alphaTexture = nullptr;
 };
 
 NORI_REGISTER_CLASS(Microfacet, "microfacet");
@@ -18,9 +18,12 @@
 
 #include <nori/bsdf.h>
 #include <nori/frame.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_COUNTER(statMirrorSamples, "BSDF samples", "mirror");
+
 /// Ideal mirror BRDF
 class Mirror : public BSDF {
 public:
@@ -38,6 +41,7 @@ public:
 
     Color3f sample(BSDFQueryRecord &bRec, const Point2f &) const 
 	{
+		NORI_STAT_ADD(statMirrorSamples, 1);
         //if (Frame::cosTheta(bRec.wi) <= 0) 
         //    return Color3f(0.0f);
 		bRec.wo = bRec.wi - 2 * bRec.wi.dot(bRec.n)*bRec.n;
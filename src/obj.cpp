@@ -18,32 +18,122 @@
 
 #include <nori/mesh.h>
 #include <nori/timer.h>
+#include <nori/trace.h>
 #include <filesystem/resolver.h>
 #include <unordered_map>
 #include <fstream>
+#include <mutex>
+#include <map>
 
 NORI_NAMESPACE_BEGIN
 
+/// Contents of an OBJ file, before the 'toWorld' transformation is applied
+struct OBJGeometry {
+    MatrixXu F;
+    MatrixXf V, N, UV;
+};
+
+/// Cache of previously loaded OBJ files (see \ref setOBJCacheEnabled())
+struct OBJCache {
+    struct Entry {
+        int64_t modificationTime;
+        std::shared_ptr<const OBJGeometry> geometry;
+    };
+
+    std::mutex mutex;
+    bool enabled = false;
+    std::map<std::string, Entry> entries;
+};
+
+static OBJCache *getOBJCache() {
+    static OBJCache *cache = new OBJCache();
+    return cache;
+}
+
+void setOBJCacheEnabled(bool enabled) {
+    OBJCache *cache = getOBJCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->enabled = enabled;
+    if (!enabled)
+        cache->entries.clear();
+}
+
 /**
  * \brief Loader for Wavefront OBJ triangle meshes
  */
 class WavefrontOBJ : public Mesh {
 public:
     WavefrontOBJ(const PropertyList &propList) {
-        typedef std::unordered_map<OBJVertex, uint32_t, OBJVertexHash> VertexMap;
-
         filesystem::path filename =
             getFileResolver()->resolve(propList.getString("filename"));
 
-        std::ifstream is(filename.str());
-        if (is.fail())
-            throw NoriException("Unable to open OBJ file \"%s\"!", filename);
         Transform trafo = propList.getTransform("toWorld", Transform());
 
-        cout << "Loading \"" << filename << "\" .. ";
-        cout.flush();
+        NORI_TRACE_SCOPE("load", "Mesh load", filename.str());
         Timer timer;
 
+        /* Reuse the parsed geometry if the file has not changed since it was last loaded */
+        OBJCache *cache = getOBJCache();
+        int64_t modificationTime = getFileModificationTime(filename.str());
+        addFileDependency(filename.str());
+        std::shared_ptr<const OBJGeometry> geometry;
+        bool cached = false;
+        {
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            auto it = cache->entries.find(filename.str());
+            if (cache->enabled && it != cache->entries.end() &&
+                it->second.modificationTime == modificationTime) {
+                geometry = it->second.geometry;
+                cached = true;
+            }
+        }
+
+        if (!geometry) {
+            geometry = parse(filename);
+
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            if (cache->enabled)
+                cache->entries[filename.str()] = OBJCache::Entry { modificationTime, geometry };
+        }
+
+        /* Apply the 'toWorld' transformation */
+        m_F = geometry->F;
+
+        m_V.resize(3, geometry->V.cols());
+        for (ptrdiff_t i=0; i<geometry->V.cols(); ++i) {
+            Point3f p = trafo * Point3f(geometry->V.col(i));
+            m_bbox.expandBy(p);
+            m_V.col(i) = p;
+        }
+
+        if (geometry->N.size() > 0) {
+            m_N.resize(3, geometry->N.cols());
+            for (ptrdiff_t i=0; i<geometry->N.cols(); ++i)
+                m_N.col(i) = (trafo * Normal3f(geometry->N.col(i))).normalized();
+        }
+
+        m_UV = geometry->UV;
+
+        m_name = filename.str();
+
+        /* Meshes may be loaded concurrently, hence the message is written at once */
+        cout << tfm::format("Loaded \"%s\" (V=%i, F=%i, took %s and %s%s)\n",
+            filename, m_V.cols(), m_F.cols(), timer.elapsedString(),
+            memString(m_F.size() * sizeof(uint32_t) +
+                      sizeof(float) * (m_V.size() + m_N.size() + m_UV.size())),
+            cached ? ", cached" : "");
+        cout.flush();
+    }
+
+protected:
+    /// Parse an OBJ file and convert it into an indexed triangle mesh
+    static std::shared_ptr<const OBJGeometry> parse(const filesystem::path &filename) {
+        typedef std::unordered_map<OBJVertex, uint32_t, OBJVertexHash> VertexMap;
+
+        std::ifstream is(filename.str());
+        if (is.fail())
+            throw NoriException("Unable to open OBJ file \"%s\"!", filename);
+
         std::vector<Vector3f>   positions;
         std::vector<Vector2f>   texcoords;
         std::vector<Vector3f>   normals;
@@ -61,8 +151,6 @@ public:
             if (prefix == "v") {
                 Point3f p;
                 line >> p.x() >> p.y() >> p.z();
-                p = trafo * p;
-                m_bbox.expandBy(p);
                 positions.push_back(p);
             } else if (prefix == "vt") {
                 Point2f tc;
@@ -71,7 +159,7 @@ public:
             } else if (prefix == "vn") {
                 Normal3f n;
                 line >> n.x() >> n.y() >> n.z();
-                normals.push_back((trafo * n).normalized());
+                normals.push_back(n);
             } else if (prefix == "f") {
                 std::string v1, v2, v3, v4;
                 line >> v1 >> v2 >> v3 >> v4;
@@ -104,34 +192,30 @@ public:
             }
         }
 
-        m_F.resize(3, indices.size()/3);
-        memcpy(m_F.data(), indices.data(), sizeof(uint32_t)*indices.size());
+        std::shared_ptr<OBJGeometry> geometry = std::make_shared<OBJGeometry>();
+
+        geometry->F.resize(3, indices.size()/3);
+        memcpy(geometry->F.data(), indices.data(), sizeof(uint32_t)*indices.size());
 
-        m_V.resize(3, vertices.size());
+        geometry->V.resize(3, vertices.size());
         for (uint32_t i=0; i<vertices.size(); ++i)
-            m_V.col(i) = positions.at(vertices[i].p-1);
+            geometry->V.col(i) = positions.at(vertices[i].p-1);
 
         if (!normals.empty()) {
-            m_N.resize(3, vertices.size());
+            geometry->N.resize(3, vertices.size());
             for (uint32_t i=0; i<vertices.size(); ++i)
-                m_N.col(i) = normals.at(vertices[i].n-1);
+                geometry->N.col(i) = normals.at(vertices[i].n-1);
         }
 
         if (!texcoords.empty()) {
-            m_UV.resize(2, vertices.size());
+            geometry->UV.resize(2, vertices.size());
             for (uint32_t i=0; i<vertices.size(); ++i)
-                m_UV.col(i) = texcoords.at(vertices[i].uv-1);
+                geometry->UV.col(i) = texcoords.at(vertices[i].uv-1);
         }
 
-        m_name = filename.str();
-        cout << "done. (V=" << m_V.cols() << ", F=" << m_F.cols() << ", took "
-             << timer.elapsedString() << " and "
-             << memString(m_F.size() * sizeof(uint32_t) +
-                          sizeof(float) * (m_V.size() + m_N.size() + m_UV.size()))
-             << ")" << endl;
+        return geometry;
     }
 
-protected:
     /// Vertex indices used by the OBJ format
     struct OBJVertex {
         uint32_t p = (uint32_t) -1;
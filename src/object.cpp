@@ -37,4 +37,13 @@ void NoriObjectFactory::registerClass(const std::string &name, const Constructor
     (*m_constructors)[name] = constr;
 }
 
+std::vector<std::string> NoriObjectFactory::getClassNames() {
+    std::vector<std::string> names;
+    if (m_constructors) {
+        for (const auto &entry : *m_constructors)
+            names.push_back(entry.first);
+    }
+    return names;
+}
+
 NORI_NAMESPACE_END
@@ -18,34 +18,43 @@
 
 #include <nori/parser.h>
 #include <nori/proplist.h>
+#include <nori/texture.h>
 #include <Eigen/Geometry>
+#include <nori/timer.h>
+#include <nori/trace.h>
 #include <pugixml.hpp>
+#include <tbb/parallel_for.h>
 #include <fstream>
+#include <iterator>
+#include <mutex>
 #include <set>
 
 NORI_NAMESPACE_BEGIN
 
 NoriObject *loadFromXML(const std::string &filename) {
-    /* Load the XML file using 'pugi' (a tiny self-contained XML parser implemented in C++) */
+    NORI_TRACE_SCOPE("load", "Scene load", filename);
+    std::ifstream is(filename, std::ios::binary);
+    if (is.fail())
+        throw NoriException("Unable to open the scene file \"%s\"!", filename);
+    std::string contents((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    return loadFromXMLString(contents, filename);
+}
+
+NoriObject *loadFromXMLString(const std::string &contents, const std::string &filename) {
+    /* Load the XML data using 'pugi' (a tiny self-contained XML parser implemented in C++) */
     pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(filename.c_str());
+    pugi::xml_parse_result result = doc.load_buffer(contents.data(), contents.size());
 
     /* Helper function: map a position offset in bytes to a more readable line/column value */
     auto offset = [&](ptrdiff_t pos) -> std::string {
-        std::fstream is(filename);
-        char buffer[1024];
-        int line = 0, linestart = 0, offset = 0;
-        while (is.good()) {
-            is.read(buffer, sizeof(buffer));
-            for (int i = 0; i < is.gcount(); ++i) {
-                if (buffer[i] == '\n') {
-                    if (offset + i >= pos)
-                        return tfm::format("line %i, col %i", line + 1, pos - linestart);
-                    ++line;
-                    linestart = offset + i;
-                }
+        int line = 0, linestart = 0;
+        for (ptrdiff_t i = 0; i < (ptrdiff_t) contents.size(); ++i) {
+            if (contents[i] == '\n') {
+                if (i >= pos)
+                    return tfm::format("line %i, col %i", line + 1, pos - linestart);
+                ++line;
+                linestart = (int) i;
             }
-            offset += (int) is.gcount();
         }
         return "byte offset " + std::to_string(pos);
     };
@@ -67,6 +76,8 @@ NoriObject *loadFromXML(const std::string &filename) {
         ESampler              = NoriObject::ESampler,
         ETest                 = NoriObject::ETest,
         EReconstructionFilter = NoriObject::EReconstructionFilter,
+        ETexture              = NoriObject::ETexture,
+        EDenoiser             = NoriObject::EDenoiser,
 
         /* Properties */
         EBoolean = NoriObject::EClassTypeCount,
@@ -99,6 +110,8 @@ NoriObject *loadFromXML(const std::string &filename) {
     tags["sampler"]    = ESampler;
     tags["rfilter"]    = EReconstructionFilter;
     tags["test"]       = ETest;
+    tags["texture"]    = ETexture;
+    tags["denoiser"]   = EDenoiser;
     tags["boolean"]    = EBoolean;
     tags["integer"]    = EInteger;
     tags["float"]      = EFloat;
@@ -127,11 +140,26 @@ NoriObject *loadFromXML(const std::string &filename) {
                                 filename, *attrs.begin(), node.name(), offset(node.offset_debug()));
     };
 
-    Eigen::Affine3f transform;
+    /* Helper function to check whether a node describes a Nori object */
+    auto isObject = [&](const pugi::xml_node &node) {
+        if (node.type() != pugi::node_element)
+            return false;
+        auto it = tags.find(node.name());
+        return it != tags.end() && (int) it->second < NoriObject::EClassTypeCount;
+    };
 
-    /* Helper function to parse a Nori XML node (recursive) */
-    std::function<NoriObject *(pugi::xml_node &, PropertyList &, int)> parseTag = [&](
-        pugi::xml_node &node, PropertyList &list, int parentTag) -> NoriObject * {
+    /* Time spent constructing and activating each object (excluding its children) */
+    struct ObjectTiming {
+        std::string description;
+        double time;
+    };
+    std::vector<ObjectTiming> timings;
+    std::mutex timingsMutex;
+
+    /* Helper function to parse a Nori XML node (recursive). Properties are
+       stored in 'list', and transform operations are applied to 'parentTransform' */
+    std::function<NoriObject *(pugi::xml_node &, PropertyList &, int, Eigen::Affine3f &)> parseTag = [&](
+        pugi::xml_node &node, PropertyList &list, int parentTag, Eigen::Affine3f &parentTransform) -> NoriObject * {
         /* Skip over comments */
         if (node.type() == pugi::node_comment || node.type() == pugi::node_declaration)
             return nullptr;
@@ -168,29 +196,61 @@ NoriObject *loadFromXML(const std::string &filename) {
             throw NoriException("Error while parsing \"%s\": node \"%s\" requires a Nori object as parent (at %s)",
                                 filename, node.name(), offset(node.offset_debug()));
 
-        if (tag == EScene)
-            node.append_attribute("type") = "scene";
-        else if (tag == ETransform)
-            transform.setIdentity();
-
+        /* Properties and transform operations are processed in sequence. Nested
+           objects don't depend on each other and are constructed in parallel,
+           which e.g. loads the meshes of a scene concurrently */
         PropertyList propList;
-        std::vector<NoriObject *> children;
+        Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+        std::vector<pugi::xml_node> objectNodes;
         for (pugi::xml_node &ch: node.children()) {
-            NoriObject *child = parseTag(ch, propList, tag);
-            if (child)
-                children.push_back(child);
+            if (isObject(ch))
+                objectNodes.push_back(ch);
+            else
+                parseTag(ch, propList, tag, transform);
+        }
+
+        std::vector<NoriObject *> children(objectNodes.size(), nullptr);
+        std::vector<std::exception_ptr> errors(objectNodes.size());
+        tbb::parallel_for(size_t(0), objectNodes.size(), [&](size_t i) {
+            try {
+                PropertyList unusedList;
+                Eigen::Affine3f unusedTransform;
+                children[i] = parseTag(objectNodes[i], unusedList, tag, unusedTransform);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+
+        /* Report the first error in document order */
+        for (size_t i=0; i<errors.size(); ++i) {
+            if (errors[i]) {
+                for (auto ch: children)
+                    delete ch;
+                std::rethrow_exception(errors[i]);
+            }
         }
 
         NoriObject *result = nullptr;
         try {
             if (currentIsObject) {
-                check_attributes(node, { "type" });
+                /* The type of the root node is implicit */
+                std::string type = "scene";
+                if (tag == EScene) {
+                    check_attributes(node, { "type" });
+                    if (node.attribute("type"))
+                        type = node.attribute("type").value();
+                } else if (tag == ETexture) {
+                    /* Textures are named after the parameter of the parent that they provide */
+                    check_attributes(node, { "type", "name" });
+                    type = node.attribute("type").value();
+                } else {
+                    check_attributes(node, { "type" });
+                    type = node.attribute("type").value();
+                }
+                Timer timer;
 
                 /* This is an object, first instantiate it */
-                result = NoriObjectFactory::createInstance(
-                    node.attribute("type").value(),
-                    propList
-                );
+                result = NoriObjectFactory::createInstance(type, propList);
 
                 if (result->getClassType() != (int) tag) {
                     throw NoriException(
@@ -201,6 +261,9 @@ NoriObject *loadFromXML(const std::string &filename) {
                         result->toString());
                 }
 
+                if (tag == ETexture)
+                    static_cast<Texture *>(result)->setName(node.attribute("name").value());
+
                 /* Add all children */
                 for (auto ch: children) {
                     result->addChild(ch);
@@ -209,6 +272,13 @@ NoriObject *loadFromXML(const std::string &filename) {
 
                 /* Activate / configure the object */
                 result->activate();
+
+                std::string description = tfm::format("%s \"%s\"", node.name(), type);
+                pugi::xml_node filename = node.find_child_by_attribute("string", "name", "filename");
+                if (filename)
+                    description += tfm::format(" (%s)", filename.attribute("value").value());
+                std::lock_guard<std::mutex> lock(timingsMutex);
+                timings.push_back(ObjectTiming { description, timer.elapsed() });
             } else {
                 /* This is a property */
                 switch (tag) {
@@ -255,7 +325,7 @@ NoriObject *loadFromXML(const std::string &filename) {
                     case ETranslate: {
                             check_attributes(node, { "value" });
                             Eigen::Vector3f v = toVector3f(node.attribute("value").value());
-                            transform = Eigen::Translation<float, 3>(v.x(), v.y(), v.z()) * transform;
+                            parentTransform = Eigen::Translation<float, 3>(v.x(), v.y(), v.z()) * parentTransform;
                         }
                         break;
                     case EMatrix: {
@@ -267,20 +337,20 @@ NoriObject *loadFromXML(const std::string &filename) {
                             for (int i=0; i<4; ++i)
                                 for (int j=0; j<4; ++j)
                                     matrix(i, j) = toFloat(tokens[i*4+j]);
-                            transform = Eigen::Affine3f(matrix) * transform;
+                            parentTransform = Eigen::Affine3f(matrix) * parentTransform;
                         }
                         break;
                     case EScale: {
                             check_attributes(node, { "value" });
                             Eigen::Vector3f v = toVector3f(node.attribute("value").value());
-                            transform = Eigen::DiagonalMatrix<float, 3>(v) * transform;
+                            parentTransform = Eigen::DiagonalMatrix<float, 3>(v) * parentTransform;
                         }
                         break;
                     case ERotate: {
                             check_attributes(node, { "angle", "axis" });
                             float angle = degToRad(toFloat(node.attribute("angle").value()));
                             Eigen::Vector3f axis = toVector3f(node.attribute("axis").value());
-                            transform = Eigen::AngleAxis<float>(angle, axis) * transform;
+                            parentTransform = Eigen::AngleAxis<float>(angle, axis) * parentTransform;
                         }
                         break;
                     case ELookAt: {
@@ -297,7 +367,7 @@ NoriObject *loadFromXML(const std::string &filename) {
                             trafo << left, newUp, dir, origin,
                                       0, 0, 0, 1;
 
-                            transform = Eigen::Affine3f(trafo) * transform;
+                            parentTransform = Eigen::Affine3f(trafo) * parentTransform;
                         }
                         break;
 
@@ -313,7 +383,33 @@ NoriObject *loadFromXML(const std::string &filename) {
     };
 
     PropertyList list;
-    return parseTag(*doc.begin(), list, EInvalid);
+    Eigen::Affine3f transform;
+    Timer loadTimer;
+    NoriObject *root = parseTag(*doc.begin(), list, EInvalid, transform);
+
+    /* Print the objects that took longest to construct, but only if loading was
+       slow (e.g. not for every small scene that is sent to the render server) */
+    const double slowLoadTime = 1000.0; /* ms */
+    if (root->getClassType() == NoriObject::EScene && loadTimer.elapsed() > slowLoadTime) {
+        std::sort(timings.begin(), timings.end(),
+            [](const ObjectTiming &a, const ObjectTiming &b) { return a.time > b.time; });
+        const size_t maxCount = 20;
+
+        cout << "Loading took " << loadTimer.elapsedString(true) << ", object construction times ("
+             << timings.size() << " objects):" << endl;
+        for (size_t i=0; i<std::min(timings.size(), maxCount); ++i)
+            cout << tfm::format("  %10s  %s", timeString(timings[i].time, true),
+                                timings[i].description) << endl;
+        if (timings.size() > maxCount) {
+            double remaining = 0;
+            for (size_t i=maxCount; i<timings.size(); ++i)
+                remaining += timings[i].time;
+            cout << tfm::format("  %10s  (%i other objects)", timeString(remaining, true),
+                                timings.size() - maxCount) << endl;
+        }
+    }
+
+    return root;
 }
 
 NORI_NAMESPACE_END
@@ -6,7 +6,7 @@
 #include <nori/bsdf.h>
 #include <nori/emitter.h>
 #include <fstream>
-#include <Eigen/src/Geometry/Transform.h>
+#include <Eigen/Geometry>
 
 #define MAXDEPTH 15
 
@@ -20,11 +20,24 @@ public:
 	{
 	}
 	Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const
+	{
+		return Li(scene, sampler, ray, nullptr);
+	}
+
+	Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray, Color3f *aovs) const
 	{
 		Intersection its; //fisrt surface interaction
+		bool hit = scene->rayIntersect(ray, its);
 
-		if (!scene->rayIntersect(ray, its))
-			return Color3f(0.0f);
+		/* The standard AOVs are taken from the first intersection */
+		if (aovs)
+			scene->evalAOVs(hit ? &its : nullptr, aovs);
+
+		if (!hit) {
+			/* Rays that escape the scene receive the radiance of the environment */
+			const Emitter *environment = scene->getEnvironment();
+			return environment ? environment->evalEnvironment(ray.d) : Color3f(0.0f);
+		}
 
 		std::vector<Mesh*> lights = scene->m_lights;
 
@@ -39,14 +52,33 @@ public:
 
 		float weight = 1.0f;
 
-		result+=recursive(scene, weight, x, sampler,its,0,ray);
+		/* Radiance from the environment, accumulated along the path */
+		Color3f environment(0.0f);
+
+		result+=recursive(scene, weight, x, sampler,its,0,ray, Color3f(1.0f), environment);
 		//ray =  ray. x =  .
 		
-		return result/(float)maxdepth;
+		return result/(float)maxdepth + environment;
 
 	}
 
-	Color3f recursive(const Scene *scene, float weight, Point3f x, Sampler *sampler, Intersection its, int depth, Ray3f ray) const
+	/// Radiance of the environment along a path ray that escaped the scene
+	Color3f escapedRadiance(const Scene *scene, const Vector3f &d) const
+	{
+		const Emitter *environment = scene->getEnvironment();
+		return environment ? environment->evalEnvironment(d) : Color3f(0.0f);
+	}
+
+	/**
+	 * \brief Radiance arriving along \c ray, which hit the surface \c its
+	 *
+	 * Returns the contribution of the area lights. The environment is only
+	 * reached by path rays that escape the scene; it is added to
+	 * \c environment instead, weighted by \c throughput (the product of
+	 * the BSDF sampling weights along the path up to \c its).
+	 */
+	Color3f recursive(const Scene *scene, float weight, Point3f x, Sampler *sampler, Intersection its, int depth, Ray3f ray,
+		const Color3f &throughput, Color3f &environment) const
 	{
 		int maxdepth = MAXDEPTH;
 
@@ -59,42 +91,46 @@ public:
 
 		Color3f result(0);
 		std::vector<Mesh*> lights = scene->m_lights;
-		int idx = (int)(sampler->next1D() * 100) % lights.size();
-		const Mesh* areaLight = lights[idx];
-		Point3f y;
-		Normal3f n;
-		float pd;
 		Vector3f wi;
 		const BSDF *bsdf = its.mesh->getBSDF();
 		bool isDiffuse = bsdf->isDiffuse();
-		const Emitter* emitter = areaLight->getEmitter();
-		areaLight->sample(y, n, pd, sampler->next2D(), sampler->next1D());
-		Color3f rad = emitter->getRad();
-		
+
 		Point3f xR, xT;
 		Ray3f pathRayT, pathRayR, pathRay;
 
-		wi = (y - x).normalized();
-		BSDFQueryRecord bquery(wi);
-
-		if (isDiffuse)
-			bquery.wi = its.shFrame.toLocal(wi);
-		else
-			bquery.wi = -wi;
-
+		BSDFQueryRecord bquery(Vector3f(0.f));
 		bquery.n = its.shFrame.n.normalized();
 		bquery.its = its;
 
-
-		float g = G(scene, x, y, its.shFrame.n.normalized(), n.normalized());
-		Color3f kr = bsdf->sample(bquery, sampler->next2D());
-		Color3f kt = 1 - kr;
-		Color3f fr = bsdf->eval(bquery); //dielectric fr = 0 
-
+		Color3f kr, kt, fr(0.0f);
 		float weight_term = 0.95f;
 
-
-		result += weight * fr* g * rad / pd;
+		/* Direct illumination by a randomly chosen area light */
+		if (!lights.empty())
+		{
+			int idx = (int)(sampler->next1D() * 100) % lights.size();
+			const Mesh* areaLight = lights[idx];
+			Point3f y;
+			Normal3f n;
+			float pd;
+			const Emitter* emitter = areaLight->getEmitter();
+			areaLight->sample(y, n, pd, sampler->next2D(), sampler->next1D());
+			Color3f rad = emitter->getRad();
+
+			wi = (y - x).normalized();
+
+			if (isDiffuse)
+				bquery.wi = its.shFrame.toLocal(wi);
+			else
+				bquery.wi = -wi;
+
+			float g = G(scene, x, y, its.shFrame.n.normalized(), n.normalized());
+			kr = bsdf->sample(bquery, sampler->next2D());
+			kt = 1 - kr;
+			fr = bsdf->eval(bquery); //dielectric fr = 0 
+
+			result += weight * fr* g * rad / pd;
+		}
 
 		Intersection _its;
 		
@@ -117,8 +153,11 @@ public:
 			if (scene->rayIntersect(pathRay, _its))
 			{
 				x = _its.p;
-				result += fr*recursive(scene, weight*weight_term, x, sampler, _its, depth + 1, pathRay);
+				result += fr*recursive(scene, weight*weight_term, x, sampler, _its, depth + 1, pathRay,
+					throughput * kr, environment);
 			}
+			else
+				environment += throughput * kr * escapedRadiance(scene, pathRay.d);
 		}
 		else
 		{
@@ -128,8 +167,11 @@ public:
 				if (scene->rayIntersect(pathRayT, _its))
 				{
 					xT = _its.p;
-					result += kt*recursive(scene, weight*weight_term, xT, sampler, _its, depth + 1, pathRayT);
+					result += kt*recursive(scene, weight*weight_term, xT, sampler, _its, depth + 1, pathRayT,
+						throughput * kt, environment);
 				}
+				else
+					environment += throughput * kt * escapedRadiance(scene, pathRayT.d);
 			}
 			if (bquery.wr != Vector3f(0.f))
 			{
@@ -137,8 +179,11 @@ public:
 				if (scene->rayIntersect(pathRayR, _its))
 				{
 					xR = _its.p;
-					result += kr*recursive(scene, weight*weight_term, xR, sampler, _its, depth + 1, pathRayR);
+					result += kr*recursive(scene, weight*weight_term, xR, sampler, _its, depth + 1, pathRayR,
+						throughput * kr, environment);
 				}
+				else
+					environment += throughput * kr * escapedRadiance(scene, pathRayR.d);
 			}
 		}
 		// reflect refract weight  ־ߴ
@@ -6,7 +6,7 @@
 #include <nori/bsdf.h>
 #include <nori/emitter.h>
 #include <fstream>
-#include <Eigen/src/Geometry/Transform.h>
+#include <Eigen/Geometry>
 
 #define MAXDEPTH 16
 
@@ -20,11 +20,24 @@ public:
 	{
 	}
 	Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const
+	{
+		return Li(scene, sampler, ray, nullptr);
+	}
+
+	Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray, Color3f *aovs) const
 	{
 		Intersection its; //fisrt surface interaction
+		bool hit = scene->rayIntersect(ray, its);
 
-		if (!scene->rayIntersect(ray, its))
-			return Color3f(0.0f);
+		/* The standard AOVs are taken from the first intersection */
+		if (aovs)
+			scene->evalAOVs(hit ? &its : nullptr, aovs);
+
+		if (!hit) {
+			/* Rays that escape the scene receive the radiance of the environment */
+			const Emitter *environment = scene->getEnvironment();
+			return environment ? environment->evalEnvironment(ray.d) : Color3f(0.0f);
+		}
 
 		std::vector<Mesh*> lights = scene->m_lights;
 
@@ -39,14 +52,84 @@ public:
 
 		float weight = 1.0f;
 
-		result += recursive(scene, weight, x, sampler, its, 0, ray);
+		/* Radiance from the environment, accumulated along the path */
+		Color3f environment(0.0f);
+
+		result += recursive(scene, weight, x, sampler, its, 0, ray, Color3f(1.0f), environment);
 		//ray =  ray. x =  .
 
-		return result / (float)maxdepth;
+		return result / (float)maxdepth + environment;
 
 	}
 
-	Color3f recursive(const Scene *scene, float weight, Point3f x, Sampler *sampler, Intersection its, int depth, Ray3f ray) const
+	/**
+	 * \brief Direct illumination by the environment at a diffuse surface
+	 *
+	 * This is the emitter sampling half of multiple importance sampling
+	 * (power heuristic). The BSDF sampling half is the path ray that
+	 * recursive() traces from the same surface, when it escapes.
+	 */
+	Color3f environmentLighting(const Scene *scene, Sampler *sampler, const Intersection &its, const Ray3f &ray) const
+	{
+		const Emitter *environment = scene->getEnvironment();
+		const BSDF *bsdf = its.mesh->getBSDF();
+		if (!environment || !bsdf->isDiffuse())
+			return Color3f(0.0f);
+
+		Color3f result(0.0f);
+		Vector3f wi = its.shFrame.toLocal(-ray.d);
+
+		/* Sample the environment */
+		Vector3f d;
+		float pdfEmitter;
+		Color3f emitterWeight = environment->sampleEnvironment(d, pdfEmitter, sampler->next2D());
+		if (pdfEmitter > 0 && !scene->rayIntersect(Ray3f(its.p, d)))
+		{
+			BSDFQueryRecord bRec(wi, its.shFrame.toLocal(d), ESolidAngle);
+			bRec.its = its;
+			float pdfBSDF = bsdf->pdf(bRec);
+			result += bsdf->eval(bRec) * Frame::cosTheta(bRec.wo) * emitterWeight
+				* powerHeuristic(pdfEmitter, pdfBSDF);
+		}
+
+		return result;
+	}
+
+	/**
+	 * \brief Radiance of the environment along a path ray that escaped the scene
+	 *
+	 * \param pdfBSDF
+	 *    Density of the direction if it was sampled at a diffuse surface
+	 *    (which also samples the environment, see environmentLighting()),
+	 *    or zero if it was chosen deterministically by a specular BSDF
+	 */
+	Color3f escapedRadiance(const Scene *scene, const Vector3f &d, float pdfBSDF) const
+	{
+		const Emitter *environment = scene->getEnvironment();
+		if (!environment)
+			return Color3f(0.0f);
+		Color3f value = environment->evalEnvironment(d);
+		if (pdfBSDF > 0)
+			value *= powerHeuristic(pdfBSDF, environment->pdfEnvironment(d));
+		return value;
+	}
+
+	static float powerHeuristic(float pdfA, float pdfB)
+	{
+		pdfA *= pdfA;
+		pdfB *= pdfB;
+		return pdfA > 0 ? pdfA / (pdfA + pdfB) : 0.0f;
+	}
+
+	/**
+	 * \brief Radiance arriving along \c ray, which hit the surface \c its
+	 *
+	 * Returns the contribution of the area lights. The environment is added
+	 * to \c environment instead, weighted by \c throughput (the product of
+	 * the BSDF sampling weights along the path up to \c its).
+	 */
+	Color3f recursive(const Scene *scene, float weight, Point3f x, Sampler *sampler, Intersection its, int depth, Ray3f ray,
+		const Color3f &throughput, Color3f &environment) const
 	{
 		int maxdepth = MAXDEPTH;
 
@@ -59,42 +142,49 @@ public:
 
 		Color3f result(0);
 		std::vector<Mesh*> lights = scene->m_lights;
-		int idx = (int)(sampler->next1D() * 100) % lights.size();
-		const Mesh* areaLight = lights[idx];
-		Point3f y;
-		Normal3f n;
-		float pd; //p_light
 		Vector3f wi;
 		const BSDF *bsdf = its.mesh->getBSDF();
 		bool isDiffuse = bsdf->isDiffuse();
-		const Emitter* emitter = areaLight->getEmitter();
-		areaLight->sample(y, n, pd, sampler->next2D(), sampler->next1D());
-		Color3f rad = emitter->getRad();
 
 		Point3f xR, xT;
 		Ray3f pathRayT, pathRayR, pathRay;
 
-		wi = (y - x).normalized();
-		BSDFQueryRecord bquery(wi);
-
-		if (isDiffuse)
-			bquery.wi = its.shFrame.toLocal(wi);
-		else
-			bquery.wi = -wi;
-
+		BSDFQueryRecord bquery(Vector3f(0.f));
 		bquery.n = its.shFrame.n.normalized();
 		bquery.its = its;
 
-
-		float g = G(scene, x, y, its.shFrame.n.normalized(), n.normalized());
-		Color3f kr = bsdf->sample(bquery, sampler->next2D());
-		Color3f kt = 1 - kr;
-		Color3f fr = bsdf->eval(bquery); // = p_brdf
-
+		Color3f kr, kt, fr;
 		float weight_term = 1.f;
 
+		/* Direct illumination by the environment */
+		environment += throughput * environmentLighting(scene, sampler, its, ray);
 
-		result += weight * fr* g * rad /pd ;
+		/* Direct illumination by a randomly chosen area light */
+		if (!lights.empty())
+		{
+			int idx = (int)(sampler->next1D() * 100) % lights.size();
+			const Mesh* areaLight = lights[idx];
+			Point3f y;
+			Normal3f n;
+			float pd; //p_light
+			const Emitter* emitter = areaLight->getEmitter();
+			areaLight->sample(y, n, pd, sampler->next2D(), sampler->next1D());
+			Color3f rad = emitter->getRad();
+
+			wi = (y - x).normalized();
+
+			if (isDiffuse)
+				bquery.wi = its.shFrame.toLocal(wi);
+			else
+				bquery.wi = -wi;
+
+			float g = G(scene, x, y, its.shFrame.n.normalized(), n.normalized());
+			kr = bsdf->sample(bquery, sampler->next2D());
+			kt = 1 - kr;
+			fr = bsdf->eval(bquery); // = p_brdf
+
+			result += weight * fr* g * rad /pd ;
+		}
 
 		Intersection _its;
 
@@ -117,8 +207,11 @@ public:
 			if (scene->rayIntersect(pathRay, _its))
 			{
 				x = _its.p;
-				result += fr * recursive(scene, weight*weight_term, x, sampler, _its, depth + 1, pathRay);
+				result += fr * recursive(scene, weight*weight_term, x, sampler, _its, depth + 1, pathRay,
+					throughput * kr, environment);
 			}
+			else
+				environment += throughput * kr * escapedRadiance(scene, pathRay.d, bsdf->pdf(bquery));
 		}
 		else
 		{
@@ -128,8 +221,11 @@ public:
 				if (scene->rayIntersect(pathRayT, _its))
 				{
 					xT = _its.p;
-					result += kt * recursive(scene, weight*weight_term, xT, sampler, _its, depth + 1, pathRayT);
+					result += kt * recursive(scene, weight*weight_term, xT, sampler, _its, depth + 1, pathRayT,
+						throughput * kt, environment);
 				}
+				else
+					environment += throughput * kt * escapedRadiance(scene, pathRayT.d, 0.0f);
 			}
 			if (bquery.wr != Vector3f(0.f))
 			{
@@ -137,8 +233,11 @@ public:
 				if (scene->rayIntersect(pathRayR, _its))
 				{
 					xR = _its.p;
-					result += kr * recursive(scene, weight*weight_term, xR, sampler, _its, depth + 1, pathRayR);
+					result += kr * recursive(scene, weight*weight_term, xR, sampler, _its, depth + 1, pathRayR,
+						throughput * kr, environment);
 				}
+				else
+					environment += throughput * kr * escapedRadiance(scene, pathRayR.d, 0.0f);
 			}
 		}
 		// reflect refract weight  ־ߴ
@@ -47,6 +47,16 @@ public:
         m_nearClip = propList.getFloat("nearClip", 1e-4f);
         m_farClip = propList.getFloat("farClip", 1e4f);
 
+        /* Optional turntable: number of views distributed over an arc of
+           'orbitAngle' degrees around the axis 'orbitAxis' through 'orbitCenter' */
+        m_viewCount = propList.getInteger("views", 1);
+        m_orbitCenter = propList.getPoint("orbitCenter", Point3f(0.0f));
+        m_orbitAxis = propList.getVector("orbitAxis", Vector3f(0.0f, 1.0f, 0.0f)).normalized();
+        m_orbitAngle = propList.getFloat("orbitAngle", 360.0f);
+        if (m_viewCount < 1)
+            throw NoriException("PerspectiveCamera: the number of views must be positive!");
+
+        m_pixelSpread = 0.0f;
         m_rfilter = NULL;
     }
 
@@ -79,6 +89,10 @@ public:
             Eigen::DiagonalMatrix<float, 3>(Vector3f(-0.5f, -0.5f * aspect, 1.0f)) *
             Eigen::Translation<float, 3>(-1.0f, -1.0f/aspect, 0.0f) * perspective).inverse();
 
+        /* Angle between the rays through neighboring pixels (at the image
+           center), which determines their footprint on textured surfaces */
+        m_pixelSpread = 2.0f / (cot * m_outputSize.x());
+
         /* If no reconstruction filter was assigned, instantiate a Gaussian filter */
         if (!m_rfilter)
             m_rfilter = static_cast<ReconstructionFilter *>(
@@ -103,11 +117,28 @@ public:
         ray.d = m_cameraToWorld * d;
         ray.mint = m_nearClip * invZ;
         ray.maxt = m_farClip * invZ;
+        ray.spread = m_pixelSpread;
         ray.update();
 
         return Color3f(1.0f);
     }
 
+    size_t getViewCount() const { return (size_t) m_viewCount; }
+
+    Camera *createView(size_t index) const {
+        /* Rotate the camera around the orbit axis */
+        float angle = degToRad(m_orbitAngle * index / (float) m_viewCount);
+        Eigen::Affine3f rotation =
+            Eigen::Translation<float, 3>(m_orbitCenter) *
+            Eigen::AngleAxis<float>(angle, m_orbitAxis) *
+            Eigen::Translation<float, 3>(-m_orbitCenter);
+
+        PerspectiveCamera *view = new PerspectiveCamera(*this);
+        view->m_cameraToWorld = Transform(rotation.matrix()) * m_cameraToWorld;
+        view->m_viewCount = 1;
+        return view;
+    }
+
     void addChild(NoriObject *obj) {
         switch (obj->getClassType()) {
             case EReconstructionFilter:
@@ -130,6 +161,7 @@ public:
             "  outputSize = %s,\n"
             "  fov = %f,\n"
             "  clip = [%f, %f],\n"
+            "  views = %i,\n"
             "  rfilter = %s\n"
             "]",
             indent(m_cameraToWorld.toString(), 18),
@@ -137,6 +169,7 @@ public:
             m_fov,
             m_nearClip,
             m_farClip,
+            m_viewCount,
             indent(m_rfilter->toString())
         );
     }
@@ -145,8 +178,13 @@ private:
     Transform m_sampleToCamera;
     Transform m_cameraToWorld;
     float m_fov;
+    float m_pixelSpread;
     float m_nearClip;
     float m_farClip;
+    int m_viewCount;
+    Point3f m_orbitCenter;
+    Vector3f m_orbitAxis;
+    float m_orbitAngle;
 };
 
 NORI_REGISTER_CLASS(PerspectiveCamera, "perspective");
@@ -0,0 +1,101 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/progress.h>
+#include <cmath>
+#include <limits>
+
+NORI_NAMESPACE_BEGIN
+
+RenderProgress::RenderProgress(int blockCount, int completedBlockCount)
+    : m_blockCount(blockCount), m_resumedBlockCount(completedBlockCount),
+      m_blocks(completedBlockCount), m_samples(0), m_rays(0) { }
+
+RenderProgress::~RenderProgress() {
+    stop();
+}
+
+RenderProgress::Status RenderProgress::getStatus() const {
+    Status status;
+    int blocks = m_blocks.load(std::memory_order_relaxed);
+    int rendered = blocks - m_resumedBlockCount;
+    double seconds = m_timer.elapsed() / 1000.0;
+
+    status.fraction = m_blockCount > 0 ? (float) blocks / m_blockCount : 1.0f;
+    status.elapsed = seconds * 1000.0;
+    status.samplesPerSecond = seconds > 0 ? m_samples.load(std::memory_order_relaxed) / seconds : 0.0;
+    status.raysPerSecond = seconds > 0 ? m_rays.load(std::memory_order_relaxed) / seconds : 0.0;
+
+    /* Extrapolate from the blocks that were rendered so far */
+    if (blocks >= m_blockCount)
+        status.remaining = 0.0;
+    else if (rendered > 0)
+        status.remaining = status.elapsed * (m_blockCount - blocks) / rendered;
+    else
+        status.remaining = std::numeric_limits<double>::infinity();
+
+    return status;
+}
+
+std::string RenderProgress::toString() const {
+    Status status = getStatus();
+    return tfm::format("%.1f%% (%.2f Msamples/s, %.2f Mrays/s, elapsed %s, ETA %s)",
+                       status.fraction * 100.0f, status.samplesPerSecond * 1e-6,
+                       status.raysPerSecond * 1e-6, timeString(status.elapsed),
+                       timeString(status.remaining));
+}
+
+std::string RenderProgress::toMachineString() const {
+    Status status = getStatus();
+    double remaining = std::isinf(status.remaining) ? -1.0 : status.remaining / 1000.0;
+    return tfm::format("progress fraction=%.4f blocks=%i/%i msamples_per_sec=%.3f "
+                       "mrays_per_sec=%.3f elapsed=%.1f eta=%.1f", status.fraction,
+                       m_blocks.load(std::memory_order_relaxed), m_blockCount,
+                       status.samplesPerSecond * 1e-6, status.raysPerSecond * 1e-6,
+                       status.elapsed / 1000.0, remaining);
+}
+
+void RenderProgress::start(float interval, EFormat format, std::ostream &os) {
+    if (m_thread.joinable())
+        throw NoriException("RenderProgress::start(): already started!");
+    m_stop = false;
+    m_thread = std::thread([this, interval, format, &os] {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto duration = std::chrono::milliseconds((int64_t) (interval * 1000));
+        while (!m_condition.wait_for(lock, duration, [&] { return m_stop; })) {
+            if (format == EMachine)
+                os << toMachineString() << endl;
+            else
+                os << "Progress: " << toString() << endl;
+        }
+    });
+}
+
+void RenderProgress::stop() {
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+NORI_NAMESPACE_END
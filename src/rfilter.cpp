@@ -32,6 +32,8 @@ public:
         m_radius = propList.getFloat("radius", 2.0f);
         /* Standard deviation of the Gaussian */
         m_stddev = propList.getFloat("stddev", 0.5f);
+        /* Importance sample the filter instead of splatting? */
+        m_importanceSampled = propList.getBoolean("importanceSampling", false);
     }
 
     float eval(float x) const {
@@ -42,7 +44,8 @@ public:
     }
 
     std::string toString() const {
-        return tfm::format("GaussianFilter[radius=%f, stddev=%f]", m_radius, m_stddev);
+        return tfm::format("GaussianFilter[radius=%f, stddev=%f, importanceSampling=%s]",
+            m_radius, m_stddev, m_importanceSampled ? "true" : "false");
     }
 protected:
     float m_stddev;
@@ -63,6 +66,8 @@ public:
         m_B = propList.getFloat("B", 1.0f / 3.0f);
         /* C parameter from the paper */
         m_C = propList.getFloat("C", 1.0f / 3.0f);
+        /* Importance sample the filter instead of splatting? */
+        m_importanceSampled = propList.getBoolean("importanceSampling", false);
     }
 
     float eval(float x) const {
@@ -81,7 +86,8 @@ public:
     }
 
     std::string toString() const {
-        return tfm::format("MitchellNetravaliFilter[radius=%f, B=%f, C=%f]", m_radius, m_B, m_C);
+        return tfm::format("MitchellNetravaliFilter[radius=%f, B=%f, C=%f, importanceSampling=%s]",
+            m_radius, m_B, m_C, m_importanceSampled ? "true" : "false");
     }
 protected:
     float m_B, m_C;
@@ -90,8 +96,9 @@ protected:
 /// Tent filter 
 class TentFilter : public ReconstructionFilter {
 public:
-    TentFilter(const PropertyList &) {
+    TentFilter(const PropertyList &propList) {
         m_radius = 1.0f;
+        m_importanceSampled = propList.getBoolean("importanceSampling", false);
     }
 
     float eval(float x) const {
@@ -99,15 +106,17 @@ public:
     }
     
     std::string toString() const {
-        return "TentFilter[]";
+        return tfm::format("TentFilter[importanceSampling=%s]",
+            m_importanceSampled ? "true" : "false");
     }
 };
 
 /// Box filter -- fastest, but prone to aliasing
 class BoxFilter : public ReconstructionFilter {
 public:
-    BoxFilter(const PropertyList &) {
+    BoxFilter(const PropertyList &propList) {
         m_radius = 0.5f;
+        m_importanceSampled = propList.getBoolean("importanceSampling", false);
     }
 
     float eval(float) const {
@@ -115,7 +124,8 @@ public:
     }
     
     std::string toString() const {
-        return "BoxFilter[]";
+        return tfm::format("BoxFilter[importanceSampling=%s]",
+            m_importanceSampled ? "true" : "false");
     }
 };
 
@@ -23,18 +23,54 @@
 #include <nori/camera.h>
 #include <nori/emitter.h>
 #include <nori/mesh.h>
+#include <nori/denoiser.h>
+#include <nori/bsdf.h>
+#include <algorithm>
 #include <ctime>
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {
+/// Standard AOVs, see \ref Scene::getAOVNames()
+enum EStandardAOV {
+    EAlbedoAOV = 0,
+    ENormalAOV,
+    EDepthAOV,
+    EPositionAOV,
+    EUVAOV,
+    EStandardAOVCount
+};
+
+static const char *standardAOVNames[EStandardAOVCount] = {
+    "albedo", "normal", "depth", "position", "uv"
+};
+
+Scene::Scene(const PropertyList &propList) {
     m_accel = new Accel();
+
+    /* Standard AOVs that are recorded along with the image */
+    for (const std::string &name : tokenize(propList.getString("aovs", ""))) {
+        /* tokenize() returns a single empty token for an empty string */
+        if (name.empty())
+            continue;
+        int type = 0;
+        while (type < EStandardAOVCount && name != standardAOVNames[type])
+            ++type;
+        if (type == EStandardAOVCount)
+            throw NoriException("Scene: unknown AOV \"%s\" (must be one of albedo, "
+                                "normal, depth, position or uv)", name);
+        if (std::find(m_aovTypes.begin(), m_aovTypes.end(), type) != m_aovTypes.end())
+            throw NoriException("Scene: the AOV \"%s\" was specified twice!", name);
+        m_aovNames.push_back(name);
+        m_aovTypes.push_back(type);
+    }
 }
 
 Scene::~Scene() {
     delete m_accel;
     delete m_sampler;
-    delete m_camera;
+    for (Camera *camera : m_cameras)
+        delete camera;
     delete m_integrator;
+    delete m_denoiser;
 
 }
 
@@ -85,8 +121,33 @@ void Scene::activate()
 
     if (!m_integrator)
         throw NoriException("No integrator was specified!");
-    if (!m_camera)
+    if (m_cameras.empty())
         throw NoriException("No camera was specified!");
+
+    /* Expand camera paths into one camera per view. All views share
+       the acceleration data structure and the emitters */
+    std::vector<Camera *> cameras;
+    for (Camera *camera : m_cameras) {
+        size_t viewCount = camera->getViewCount();
+        if (viewCount == 1) {
+            cameras.push_back(camera);
+            continue;
+        }
+        for (size_t i=0; i<viewCount; ++i)
+            cameras.push_back(camera->createView(i));
+        delete camera;
+    }
+    m_cameras = cameras;
+
+    /* The denoiser is guided by the albedo, normal and depth AOVs */
+    if (m_denoiser) {
+        for (int type : { EAlbedoAOV, ENormalAOV, EDepthAOV }) {
+            if (std::find(m_aovTypes.begin(), m_aovTypes.end(), type) == m_aovTypes.end()) {
+                m_aovNames.push_back(standardAOVNames[type]);
+                m_aovTypes.push_back(type);
+            }
+        }
+    }
     
     if (!m_sampler) {
         /* Create a default (independent) sampler */
@@ -121,6 +182,11 @@ void Scene::addChild(NoriObject *obj) {
 		cout << "case EEmitter" << endl;
 		Emitter *emitter = static_cast<Emitter *>(obj);
 		m_emitters.push_back(emitter);
+		if (emitter->isEnvironment()) {
+			if (m_environment)
+				throw NoriException("There can only be one environment emitter per scene!");
+			m_environment = emitter;
+		}
 
 	}
 	break;
@@ -132,9 +198,13 @@ void Scene::addChild(NoriObject *obj) {
 		break;
 
 	case ECamera:
-		if (m_camera)
-			throw NoriException("There can only be one camera per scene!");
-		m_camera = static_cast<Camera *>(obj);
+		m_cameras.push_back(static_cast<Camera *>(obj));
+		break;
+
+	case EDenoiser:
+		if (m_denoiser)
+			throw NoriException("There can only be one denoiser per scene!");
+		m_denoiser = static_cast<Denoiser *>(obj);
 		break;
 
 	case EIntegrator:
@@ -150,6 +220,54 @@ void Scene::addChild(NoriObject *obj) {
     }
 }
 
+void Scene::evalAOVs(const Intersection *its, Color3f *values) const {
+    for (size_t i = 0; i < m_aovTypes.size(); ++i) {
+        Color3f &value = values[i];
+
+        /* Escaped rays produce zero in all AOVs */
+        if (!its) {
+            value = Color3f(0.0f);
+            continue;
+        }
+
+        switch (m_aovTypes[i]) {
+            case EAlbedoAOV: {
+                    const BSDF *bsdf = its->mesh->getBSDF();
+                    value = bsdf ? bsdf->getAlbedo(*its) : Color3f(0.0f);
+                }
+                break;
+
+            case ENormalAOV:
+                value = Color3f(its->shFrame.n.x(), its->shFrame.n.y(), its->shFrame.n.z());
+                break;
+
+            case EDepthAOV:
+                value = Color3f(its->t);
+                break;
+
+            case EPositionAOV:
+                value = Color3f(its->p.x(), its->p.y(), its->p.z());
+                break;
+
+            case EUVAOV:
+                value = Color3f(its->uv.x(), its->uv.y(), 0.0f);
+                break;
+        }
+    }
+}
+
+/* Defined here rather than in integrator.h, since it needs the complete Scene */
+Color3f Integrator::Li(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                       Color3f *aovs) const {
+    /* This integrator does not share its first intersection, find it separately */
+    if (!scene->getAOVNames().empty()) {
+        Intersection its;
+        bool hit = scene->rayIntersect(ray, its);
+        scene->evalAOVs(hit ? &its : nullptr, aovs);
+    }
+    return Li(scene, sampler, ray);
+}
+
 std::string Scene::toString() const {
     std::string meshes;
     for (size_t i=0; i<m_meshes.size(); ++i) {
@@ -159,17 +277,26 @@ std::string Scene::toString() const {
         meshes += "\n";
     }
 
+    std::string cameras;
+    for (size_t i=0; i<m_cameras.size(); ++i) {
+        cameras += std::string("  ") + indent(m_cameras[i]->toString(), 2);
+        if (i + 1 < m_cameras.size())
+            cameras += ",";
+        cameras += "\n";
+    }
+
     return tfm::format(
         "Scene[\n"
         "  integrator = %s,\n"
         "  sampler = %s\n"
-        "  camera = %s,\n"
+        "  cameras = {\n"
+        "  %s  },\n"
         "  meshes = {\n"
         "  %s  }\n"
         "]",
         indent(m_integrator->toString()),
         indent(m_sampler->toString()),
-        indent(m_camera->toString()),
+        indent(cameras, 2),
         indent(meshes, 2)
     );
 }
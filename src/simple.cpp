@@ -40,9 +40,8 @@ public:
 		//visibility check - > x p ray intersectϴ°  x?
 
 		Ray3f _ray(its.p,direction);
-		Intersection _its;
 
-		if (scene->rayIntersect(_ray, _its))
+		if (scene->rayIntersect(_ray))
 			result = 0;
 		
 
@@ -0,0 +1,160 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Owen-scrambled Sobol sampler
+ *
+ * Every call to \ref next1D() or \ref next2D() draws from the first one or
+ * two dimensions of the Sobol sequence, which are stratified in all
+ * elementary intervals when the sample count is a power of two. The
+ * dimensions of a sample are decorrelated from each other ("padding") and
+ * from those of neighboring pixels by randomly shuffling the sample index
+ * and applying nested uniform (Owen) scrambling to the points. Both use
+ * the hash-based approach by Burley ("Practical Hash-based Owen
+ * Scrambling", JCGT 2020), seeded by the pixel, the dimension and \c seed.
+ *
+ * Consecutive rendering passes continue the same sequence, hence the
+ * samples of \c n passes together form a single larger Sobol point set.
+ */
+class SobolSampler : public Sampler {
+public:
+    SobolSampler(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+
+        /* Seed of the scrambling (renderings with different seeds are independent) */
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<SobolSampler> cloned(new SobolSampler());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
+        return cloned;
+    }
+
+    void prepare(const ImageBlock &, uint32_t pass) {
+        m_pass = pass;
+    }
+
+    void generate(const Point2i &pixel) {
+        m_pixelSeed = hash({ (uint32_t) pixel.x(), (uint32_t) pixel.y(), m_seed });
+        m_sampleIndex = (uint32_t) (m_pass * m_sampleCount);
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t seed = hash({ m_pixelSeed, m_dimension++ });
+        uint32_t index = nestedUniformScramble(m_sampleIndex, seed);
+        return toFloat(nestedUniformScramble(sobol0(index), hash({ seed, 0 })));
+    }
+
+    Point2f next2D() {
+        /* Both components share the shuffled index, which preserves the
+           2D stratification of the first two Sobol dimensions */
+        uint32_t seed = hash({ m_pixelSeed, m_dimension++ });
+        uint32_t index = nestedUniformScramble(m_sampleIndex, seed);
+        return Point2f(
+            toFloat(nestedUniformScramble(sobol0(index), hash({ seed, 0 }))),
+            toFloat(nestedUniformScramble(sobol1(index), hash({ seed, 1 })))
+        );
+    }
+
+    void next1DArray(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = SobolSampler::next1D();
+    }
+
+    void next2DArray(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = SobolSampler::next2D();
+    }
+
+    uint32_t getSeed() const { return m_seed; }
+
+    std::string toString() const {
+        return tfm::format("SobolSampler[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    SobolSampler() { }
+
+    static uint32_t reverseBits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    /// First Sobol dimension (the van der Corput sequence)
+    static uint32_t sobol0(uint32_t index) {
+        return reverseBits(index);
+    }
+
+    /// Second Sobol dimension (primitive polynomial x + 1)
+    static uint32_t sobol1(uint32_t index) {
+        uint32_t result = 0;
+        for (uint32_t v = 0x80000000u; index; index >>= 1, v ^= v >> 1) {
+            if (index & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    /**
+     * \brief Nested uniform scrambling of a 32-bit fixed point number
+     *
+     * The Laine-Karras hash only lets lower bits affect higher ones, so
+     * the input is bit-reversed to let higher digits affect lower ones.
+     */
+    static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+        x = reverseBits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverseBits(x);
+    }
+
+    /// Convert a 32-bit fixed point number to a float in [0, 1)
+    static float toFloat(uint32_t x) {
+        /* Only keep as many bits as the mantissa can represent exactly */
+        return (float) (x >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint32_t m_seed = 0;
+    uint32_t m_pass = 0;
+    uint32_t m_pixelSeed = 0;
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(SobolSampler, "sobol");
+NORI_NAMESPACE_END
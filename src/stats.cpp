@@ -0,0 +1,148 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/stats.h>
+
+#if defined(NORI_ENABLE_STATS)
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    struct StatEntry {
+        Statistics::EType type;
+        std::string category;
+        std::string name;
+        int slot;
+        int slotCount;
+    };
+
+    /// Padding (in slots) around the slots of each thread to avoid false sharing
+    const int SlotPadding = 64 / sizeof(int64_t);
+
+    struct StatRegistry {
+        std::mutex mutex;
+        std::vector<StatEntry> entries;
+        std::vector<int64_t *> threadSlots;
+        int slotCount = 0;
+    };
+
+    /* Statistics are registered during static initialization, hence the
+       registry must be constructed on first use */
+    StatRegistry &getRegistry() {
+        static StatRegistry registry;
+        return registry;
+    }
+}
+
+int Statistics::add(EType type, const char *category, const char *name, int slotCount) {
+    StatRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (registry.slotCount + slotCount > MaxSlots)
+        throw NoriException("Statistics::add(): out of slots while registering \"%s\"!", name);
+    int slot = registry.slotCount;
+    registry.entries.push_back(StatEntry { type, category, name, slot, slotCount });
+    registry.slotCount += slotCount;
+    return slot;
+}
+
+int64_t *Statistics::allocateThreadSlots() {
+    /* The slots of a thread are never released, since the thread pool
+       keeps its threads alive until the end of the program */
+    int64_t *slots = new int64_t[MaxSlots + 2 * SlotPadding]() + SlotPadding;
+    StatRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threadSlots.push_back(slots);
+    return slots;
+}
+
+void Statistics::print(std::ostream &os) {
+    StatRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    /* Sum up the values of all threads */
+    std::vector<int64_t> values(MaxSlots, 0);
+    for (const int64_t *slots : registry.threadSlots)
+        for (int i = 0; i < registry.slotCount; ++i)
+            values[i] += slots[i];
+
+    std::map<std::string, std::vector<const StatEntry *>> categories;
+    for (const StatEntry &entry : registry.entries)
+        categories[entry.category].push_back(&entry);
+
+    os << "Statistics:" << endl;
+    for (auto &category : categories) {
+        std::sort(category.second.begin(), category.second.end(),
+            [](const StatEntry *a, const StatEntry *b) { return a->name < b->name; });
+        os << "  " << category.first << endl;
+
+        for (const StatEntry *entry : category.second) {
+            const int64_t *v = &values[entry->slot];
+            os << "    " << std::left << std::setw(38) << entry->name << std::right;
+
+            switch (entry->type) {
+                case ECounter:
+                    os << std::setw(16) << v[0] << endl;
+                    break;
+
+                case ERatio:
+                    os << std::setw(16) << tfm::format("%i / %i", v[0], v[1]);
+                    if (v[1] > 0)
+                        os << tfm::format(" (%.2f%%)", 100.0 * v[0] / v[1]);
+                    os << endl;
+                    break;
+
+                case EHistogram: {
+                        int64_t total = 0, sum = 0;
+                        for (int i = 0; i < entry->slotCount; ++i) {
+                            total += v[i];
+                            sum += v[i] * i;
+                        }
+                        os << std::setw(16) << total;
+                        if (total > 0)
+                            os << tfm::format(" (mean %.3f)", (double) sum / total);
+                        os << endl;
+                        for (int i = 0; i < entry->slotCount; ++i) {
+                            if (v[i] == 0)
+                                continue;
+                            std::string label = tfm::format("%s%i", i + 1 == entry->slotCount ? ">= " : "", i);
+                            os << "      " << std::left << std::setw(36) << label << std::right
+                               << std::setw(16) << v[i]
+                               << tfm::format(" (%.2f%%)", 100.0 * v[i] / total) << endl;
+                        }
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+void Statistics::reset() {
+    StatRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (int64_t *slots : registry.threadSlots)
+        std::fill(slots, slots + MaxSlots, (int64_t) 0);
+}
+
+NORI_NAMESPACE_END
+
+#endif
@@ -0,0 +1,222 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/texcache.h>
+
+NORI_NAMESPACE_BEGIN
+
+/// Pack a texture identifier, mip-map level and tile position into a cache key
+static inline uint64_t tileKey(uint32_t id, int level, int x, int y) {
+    return ((uint64_t) id << 44) | ((uint64_t) level << 38) |
+           ((uint64_t) y << 19) | (uint64_t) x;
+}
+
+/// Increment a counter that is only written by one thread (no atomic read-modify-write)
+static inline void increment(std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+struct TextureCache::ThreadState {
+    struct Slot {
+        uint64_t key;
+        std::shared_ptr<const Tile> tile;
+    };
+
+    Slot slots[ThreadSlotCount];
+    uint32_t epoch = 0;
+
+    /* Only written by the owning thread, read when printing the statistics */
+    std::atomic<uint64_t> hits, misses;
+
+    ThreadState() : hits(0), misses(0) { }
+};
+
+const int TextureCache::TileSize;
+const int TextureCache::ThreadSlotCount;
+
+TextureCache::TextureCache()
+    : m_memoryLimit(256 * 1024 * 1024), m_memory(0), m_peakMemory(0),
+      m_epoch(0) { }
+
+TextureCache *TextureCache::getInstance() {
+    static TextureCache cache;
+    return &cache;
+}
+
+uint32_t TextureCache::registerProvider(const TileProvider *provider) {
+    std::lock_guard<std::mutex> lock(m_providerMutex);
+    uint32_t id = m_nextId;
+    m_nextId = (m_nextId + 1) % (1 << 20);
+    m_providers[id] = provider;
+    return id;
+}
+
+void TextureCache::unregisterProvider(uint32_t id) {
+    {
+        std::lock_guard<std::mutex> lock(m_providerMutex);
+        m_providers.erase(id);
+    }
+
+    for (Shard &shard : m_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.entries.begin(); it != shard.entries.end(); ) {
+            if ((it->key >> 44) == id) {
+                shard.index.erase(it->key);
+                shard.memory -= sizeof(Tile);
+                m_memory -= sizeof(Tile);
+                it = shard.entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /* The identifier may be reused by another texture later on */
+    m_epoch++;
+}
+
+TextureCache::ThreadState *TextureCache::getThreadState() {
+    static thread_local ThreadState *state = nullptr;
+    if (!state) {
+        /* The state of a thread is never released, since the thread pool
+           keeps its threads alive until the end of the program */
+        state = new ThreadState();
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        m_threadStates.push_back(state);
+    }
+    return state;
+}
+
+const TextureCache::Tile *TextureCache::lookup(uint32_t id, int level, int x, int y) {
+    uint64_t key = tileKey(id, level, x, y);
+    ThreadState *state = getThreadState();
+
+    /* Drop the references of this thread if a texture was unregistered */
+    uint32_t epoch = m_epoch.load(std::memory_order_acquire);
+    if (state->epoch != epoch) {
+        for (ThreadState::Slot &slot : state->slots)
+            slot.tile.reset();
+        state->epoch = epoch;
+    }
+
+    ThreadState::Slot &slot = state->slots[
+        ((key * 0x9E3779B97F4A7C15ull) >> 32) & (ThreadSlotCount - 1)];
+    if (slot.tile && slot.key == key) {
+        increment(state->hits);
+        return slot.tile.get();
+    }
+
+    slot.tile = lookupShared(id, level, x, y, state);
+    slot.key = key;
+    return slot.tile.get();
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::lookupShared(uint32_t id, int level, int x, int y,
+                                                                    ThreadState *state) {
+    uint64_t key = tileKey(id, level, x, y);
+    Shard &shard = m_shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            /* Move the tile to the front of the LRU list */
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            increment(state->hits);
+            return it->second->tile;
+        }
+    }
+
+    /* Load the tile without holding the lock, so that other
+       lookups in the same shard are not blocked by file I/O */
+    increment(state->misses);
+    const TileProvider *provider;
+    {
+        std::lock_guard<std::mutex> lock(m_providerMutex);
+        auto it = m_providers.find(id);
+        if (it == m_providers.end())
+            throw NoriException("TextureCache::lookup(): unknown texture %i!", id);
+        provider = it->second;
+    }
+    std::shared_ptr<const Tile> tile = provider->loadTile(level, x, y);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        /* Another thread loaded the same tile in the meantime */
+        return it->second->tile;
+    }
+
+    shard.entries.push_front(Entry { key, tile });
+    shard.index[key] = shard.entries.begin();
+    shard.memory += sizeof(Tile);
+    size_t memory = (m_memory += sizeof(Tile));
+
+    size_t peak = m_peakMemory;
+    while (memory > peak && !m_peakMemory.compare_exchange_weak(peak, memory))
+        ;
+
+    /* Evict the least recently used tiles of this shard (tiles that are still
+       referenced by a lookup in progress are released once it is done) */
+    size_t shardLimit = m_memoryLimit / ShardCount;
+    while (shard.memory > shardLimit && shard.entries.size() > 1) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        shard.memory -= sizeof(Tile);
+        m_memory -= sizeof(Tile);
+    }
+
+    return tile;
+}
+
+uint64_t TextureCache::getLookupCount() const {
+    std::lock_guard<std::mutex> lock(m_threadMutex);
+    uint64_t count = 0;
+    for (const ThreadState *state : m_threadStates)
+        count += state->hits + state->misses;
+    return count;
+}
+
+void TextureCache::resetStatistics() {
+    {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        for (ThreadState *state : m_threadStates) {
+            state->hits = 0;
+            state->misses = 0;
+        }
+    }
+    m_peakMemory = (size_t) m_memory;
+}
+
+std::string TextureCache::toString() const {
+    uint64_t hits = 0, misses = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        for (const ThreadState *state : m_threadStates) {
+            hits += state->hits;
+            misses += state->misses;
+        }
+    }
+    return tfm::format(
+        "Texture cache: %i tile lookups, %.2f%% hit rate, %s resident (peak %s, limit %s)",
+        hits + misses, hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+        memString(m_memory), memString(m_peakMemory), memString(m_memoryLimit));
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,167 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <nori/trace.h>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    struct TraceEvent {
+        const char *category;
+        const char *name;
+        int64_t begin, end;
+        int64_t index;
+        std::string detail;
+    };
+
+    /// Ring buffer with the most recent events of one thread
+    struct ThreadTrace {
+        std::vector<TraceEvent> events;
+        size_t next = 0;
+        bool wrapped = false;
+        int id;
+    };
+
+    struct TraceRegistry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadTrace>> threads;
+        size_t eventsPerThread = 0;
+        std::chrono::steady_clock::time_point epoch;
+    };
+
+    TraceRegistry &getRegistry() {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    ThreadTrace *getThreadTrace() {
+        static thread_local ThreadTrace *trace = nullptr;
+        if (!trace) {
+            TraceRegistry &registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.threads.emplace_back(new ThreadTrace());
+            trace = registry.threads.back().get();
+            trace->events.resize(registry.eventsPerThread);
+            trace->id = (int) registry.threads.size() - 1;
+        }
+        return trace;
+    }
+
+    std::string escapeJSON(const std::string &str) {
+        std::string result;
+        for (char c : str) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if ((unsigned char) c < 0x20) {
+                result += tfm::format("\\u%04x", (int) c);
+            } else {
+                result += c;
+            }
+        }
+        return result;
+    }
+}
+
+std::atomic<bool> Trace::m_enabled(false);
+
+void Trace::enable(size_t eventsPerThread) {
+    TraceRegistry &registry = getRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (!registry.threads.empty())
+            throw NoriException("Trace::enable(): tracing was already enabled!");
+        registry.eventsPerThread = std::max(eventsPerThread, (size_t) 1);
+        registry.epoch = std::chrono::steady_clock::now();
+    }
+    m_enabled = true;
+}
+
+int64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - getRegistry().epoch).count();
+}
+
+void Trace::record(const char *category, const char *name, int64_t begin,
+                   int64_t end, int64_t index, const std::string &detail) {
+    ThreadTrace *trace = getThreadTrace();
+    TraceEvent &event = trace->events[trace->next];
+    event.category = category;
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.index = index;
+    event.detail = detail;
+
+    if (++trace->next == trace->events.size()) {
+        trace->next = 0;
+        trace->wrapped = true;
+    }
+}
+
+void Trace::save(const std::string &filename) {
+    std::ofstream os(filename);
+    if (!os)
+        throw NoriException("Unable to write \"%s\"!", filename);
+
+    TraceRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    size_t eventCount = 0, droppedCount = 0;
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+    bool first = true;
+    for (const auto &trace : registry.threads) {
+        os << (first ? "" : ",\n")
+           << tfm::format("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %i, "
+                          "\"args\": {\"name\": \"Thread %i\"}}", trace->id, trace->id);
+        first = false;
+
+        /* Write the events of the thread from the oldest to the newest one */
+        size_t size = trace->wrapped ? trace->events.size() : trace->next;
+        size_t start = trace->wrapped ? trace->next : 0;
+        for (size_t i = 0; i < size; ++i) {
+            const TraceEvent &event = trace->events[(start + i) % trace->events.size()];
+            os << tfm::format(",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, "
+                              "\"tid\": %i, \"ts\": %.3f, \"dur\": %.3f", event.name,
+                              event.category, trace->id, event.begin / 1000.0,
+                              (event.end - event.begin) / 1000.0);
+            if (event.index >= 0)
+                os << ", \"args\": {\"index\": " << event.index << "}";
+            else if (!event.detail.empty())
+                os << ", \"args\": {\"detail\": \"" << escapeJSON(event.detail) << "\"}";
+            os << "}";
+        }
+        eventCount += size;
+        if (trace->wrapped)
+            droppedCount += 1;
+    }
+    os << endl << "]}" << endl;
+
+    cout << "Wrote " << eventCount << " trace events from " << registry.threads.size()
+         << " threads to \"" << filename << "\"";
+    if (droppedCount > 0)
+        cout << " (the oldest events of " << droppedCount << " threads were overwritten)";
+    cout << endl;
+}
+
+NORI_NAMESPACE_END
@@ -23,6 +23,8 @@
 #include <nori/sampler.h>
 #include <hypothesis.h>
 #include <pcg32.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 /*
  * =======================================================================
@@ -54,6 +56,11 @@ NORI_NAMESPACE_BEGIN
  *
  * 2. that the average radiance received by a camera within some scene
  *    matches a given value (modulo noise).
+ *
+ * The samples are generated in parallel, in chunks of a fixed size that
+ * each use their own random number streams. The statistics of the chunks
+ * are combined in a fixed order, hence the result does not depend on the
+ * number of threads.
  */
 class StudentsTTest : public NoriObject {
 public:
@@ -99,6 +106,57 @@ public:
         }
     }
 
+    /// Sample mean and sum of squared deviations of a chunk of samples
+    struct Statistics {
+        double count = 0, mean = 0, m2 = 0;
+
+        /* Numerically robust online variance estimation using an
+           algorithm proposed by Donald Knuth (TAOCP vol.2, 3rd ed., p.232) */
+        void add(double value) {
+            count += 1;
+            double delta = value - mean;
+            mean += delta / count;
+            m2 += delta * (value - mean);
+        }
+
+        /// Combine with the statistics of another chunk (Chan et al.)
+        void add(const Statistics &other) {
+            double total = count + other.count, delta = other.mean - mean;
+            if (total == 0)
+                return;
+            mean += delta * other.count / total;
+            m2 += other.m2 + delta * delta * count * other.count / total;
+            count = total;
+        }
+    };
+
+    /**
+     * \brief Estimate the mean and variance of a random variable in parallel
+     *
+     * \param func
+     *    Function that draws the samples with indices <tt>[begin, end)</tt>
+     *    of the chunk with the given index and records them in a \ref
+     *    Statistics instance
+     */
+    template <typename Func> std::pair<double, double> estimate(const Func &func) const {
+        const int chunkSize = 4096;
+        int chunkCount = (m_sampleCount + chunkSize - 1) / chunkSize;
+        std::vector<Statistics> chunks(chunkCount);
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, chunkCount),
+            [&](const tbb::blocked_range<int> &range) {
+                for (int chunk = range.begin(); chunk != range.end(); ++chunk)
+                    func(chunk, chunk * chunkSize,
+                         std::min(m_sampleCount, (chunk + 1) * chunkSize), chunks[chunk]);
+            }
+        );
+
+        Statistics stats;
+        for (const Statistics &chunk : chunks)
+            stats.add(chunk);
+        return std::make_pair(stats.mean, stats.m2 / (m_sampleCount - 1));
+    }
+
     /// Invoke a series of t-tests on the provided input
     void activate() {
         int total = 0, passed = 0;
@@ -123,18 +181,16 @@ public:
                     BSDFQueryRecord bRec(sphericalDirection(degToRad(angle), 0));
 
                     cout << "Drawing " << m_sampleCount << " samples .. " << endl;
-                    double mean=0, variance = 0;
-                    for (int k=0; k<m_sampleCount; ++k) {
-                        Point2f sample(random.nextFloat(), random.nextFloat());
-                        double result = (double) bsdf->sample(bRec, sample).getLuminance();
-
-                        /* Numerically robust online variance estimation using an
-                           algorithm proposed by Donald Knuth (TAOCP vol.2, 3rd ed., p.232) */
-                        double delta = result - mean;
-                        mean += delta / (double) (k+1);
-                        variance += delta * (result - mean);
-                    }
-                    variance /= m_sampleCount - 1;
+                    uint64_t seed = random.nextUInt();
+                    double mean, variance;
+                    std::tie(mean, variance) = estimate([&](int chunk, int begin, int end, Statistics &stats) {
+                        pcg32 rng(seed, (uint64_t) chunk);
+                        BSDFQueryRecord query(bRec);
+                        for (int k=begin; k<end; ++k) {
+                            Point2f sample(rng.nextFloat(), rng.nextFloat());
+                            stats.add((double) bsdf->sample(query, sample).getLuminance());
+                        }
+                    });
                     std::pair<bool, std::string>
                         result = hypothesis::students_t_test(mean, variance, reference,
                             m_sampleCount, m_significanceLevel, (int) m_references.size());
@@ -148,8 +204,8 @@ public:
             if (m_references.size() != m_scenes.size())
                 throw NoriException("Specified a different number of scenes and reference values!");
 
-            Sampler *sampler = static_cast<Sampler *>(
-                NoriObjectFactory::createInstance("independent", PropertyList()));
+            std::unique_ptr<Sampler> prototype(static_cast<Sampler *>(
+                NoriObjectFactory::createInstance("independent", PropertyList())));
 
             int ctr = 0;
             for (auto scene : m_scenes) {
@@ -163,25 +219,25 @@ public:
 
                 cout << "Generating " << m_sampleCount << " paths.. " << endl;
 
-                double mean = 0, variance = 0;
-                for (int k=0; k<m_sampleCount; ++k) {
-                    /* Sample a ray from the camera */
-                    Ray3f ray;
-                    Point2f pixelSample = (sampler->next2D().array()
-                        * camera->getOutputSize().cast<float>().array()).matrix();
-                    Color3f value = camera->sampleRay(ray, pixelSample, sampler->next2D());
-
-                    /* Compute the incident radiance */
-                    value *= integrator->Li(scene, sampler, ray);
-
-                    /* Numerically robust online variance estimation using an
-                       algorithm proposed by Donald Knuth (TAOCP vol.2, 3rd ed., p.232) */
-                    double result = (double) value.getLuminance();
-                    double delta = result - mean;
-                    mean += delta / (double) (k+1);
-                    variance += delta * (result - mean);
-                }
-                variance /= m_sampleCount - 1;
+                double mean, variance;
+                std::tie(mean, variance) = estimate([&](int chunk, int begin, int end, Statistics &stats) {
+                    /* Every path uses its own sample stream (the chunk acts as the pixel) */
+                    std::unique_ptr<Sampler> sampler(prototype->clone());
+                    sampler->generate(Point2i(chunk, 0));
+
+                    for (int k=begin; k<end; ++k) {
+                        /* Sample a ray from the camera */
+                        Ray3f ray;
+                        Point2f pixelSample = (sampler->next2D().array()
+                            * camera->getOutputSize().cast<float>().array()).matrix();
+                        Color3f value = camera->sampleRay(ray, pixelSample, sampler->next2D());
+
+                        /* Compute the incident radiance */
+                        value *= integrator->Li(scene, sampler.get(), ray);
+                        stats.add((double) value.getLuminance());
+                        sampler->advance();
+                    }
+                });
 
                 std::pair<bool, std::string>
                     result = hypothesis::students_t_test(mean, variance, reference,
@@ -229,4 +229,99 @@ float Warp::squareToBeckmannPdf(const Vector3f &m, float alpha)
 	return result;
 }
 
+/// Sample the slopes of visible normals of an isotropic Beckmann distribution with alpha=1
+static Point2f sampleVisibleSlopes(float thetaI, const Point2f &sample) {
+    const float SQRT_PI_INV = 1.0f / std::sqrt((float) M_PI);
+
+    /* Special case (normal incidence) */
+    if (thetaI < 1e-4f) {
+        float r = std::sqrt(-std::log(1.0f - sample.x())),
+              phi = 2.0f * (float) M_PI * sample.y();
+        return Point2f(r * std::cos(phi), r * std::sin(phi));
+    }
+
+    /* Numerically invert the CDF of the slope in x direction. The search
+       interval is parameterized in the domain of erf() */
+    float tanThetaI = std::tan(thetaI),
+          cotThetaI = 1.0f / tanThetaI;
+
+    float a = -1.0f, c = std::erf(cotThetaI);
+    float sampleX = std::max(sample.x(), 1e-6f);
+
+    /* Initial guess: inverse of a fitted approximation of the CDF */
+    float fit = 1.0f + thetaI * (-0.876f + thetaI * (0.4265f - 0.0594f * thetaI));
+    float b = c - (1.0f + c) * std::pow(1.0f - sampleX, fit);
+
+    /* Normalization factor of the CDF */
+    float normalization = 1.0f / (1.0f + c + SQRT_PI_INV *
+        tanThetaI * std::exp(-cotThetaI * cotThetaI));
+
+    for (int it = 0; it < 10; ++it) {
+        /* Fall back to bisection when Newton's method leaves the
+           interval (this also catches NaNs) */
+        if (!(b >= a && b <= c))
+            b = 0.5f * (a + c);
+
+        /* Evaluate the CDF and its derivative */
+        float invErf = erfinv(b);
+        float value = normalization * (1.0f + b + SQRT_PI_INV *
+            tanThetaI * std::exp(-invErf * invErf)) - sampleX;
+        float derivative = normalization * (1.0f - invErf * tanThetaI);
+
+        if (std::abs(value) < 1e-5f)
+            break;
+
+        if (value > 0)
+            c = b;
+        else
+            a = b;
+
+        b -= value / derivative;
+    }
+
+    /* The slope in y direction is simply normally distributed */
+    return Point2f(erfinv(b), erfinv(2.0f * std::max(sample.y(), 1e-6f) - 1.0f));
+}
+
+Vector3f Warp::squareToBeckmannVisible(const Point2f &sample, const Vector3f &wi, float alpha) {
+    /* Stretch 'wi' to obtain the configuration with unit roughness */
+    Vector3f wiStretched = Vector3f(alpha * wi.x(), alpha * wi.y(), wi.z()).normalized();
+
+    float theta = 0.0f, phi = 0.0f;
+    if (wiStretched.z() < 0.99999f) {
+        theta = std::acos(wiStretched.z());
+        phi = std::atan2(wiStretched.y(), wiStretched.x());
+    }
+    float sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+
+    /* Sample the slopes, rotate them into place and unstretch */
+    Point2f slope = sampleVisibleSlopes(theta, sample);
+    slope = Point2f(
+        alpha * (cosPhi * slope.x() - sinPhi * slope.y()),
+        alpha * (sinPhi * slope.x() + cosPhi * slope.y()));
+
+    return Vector3f(-slope.x(), -slope.y(), 1.0f).normalized();
+}
+
+float Warp::squareToBeckmannVisiblePdf(const Vector3f &m, const Vector3f &wi, float alpha) {
+    float cosThetaI = Frame::cosTheta(wi), dotWiM = wi.dot(m);
+    if (cosThetaI <= 0 || dotWiM <= 0 || m.z() <= 0)
+        return 0.0f;
+
+    /* D(m) G1(wi) <wi, m> / cos(theta_i), where squareToBeckmannPdf() = D(m) cos(theta_m) */
+    return squareToBeckmannPdf(m, alpha) / m.z() * beckmannSmithG1(wi, alpha) * dotWiM / cosThetaI;
+}
+
+float Warp::beckmannSmithG1(const Vector3f &v, float alpha) {
+    float tanTheta = std::abs(Frame::tanTheta(v));
+    if (tanTheta == 0.0f)
+        return 1.0f;
+
+    /* G1 = 1 / (1 + Lambda(a)) with a = 1 / (alpha tan(theta)) */
+    float a = 1.0f / (alpha * tanTheta);
+    float lambda = 0.5f * (std::erf(a) - 1.0f) +
+        std::exp(-a * a) / (2.0f * a * std::sqrt((float) M_PI));
+    return 1.0f / (1.0f + lambda);
+}
+
 NORI_NAMESPACE_END
@@ -31,6 +31,8 @@
 #include <nanogui/messagedialog.h>
 #include <pcg32.h>
 #include <hypothesis.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 /* =======================================================================
  *   WARNING    WARNING    WARNING    WARNING    WARNING    WARNING
@@ -118,33 +120,46 @@ public:
         if (pointType == Grid || pointType == Stratified)
             pointCount = sqrtVal*sqrtVal;
 
-        pcg32 rng;
         positions.resize(3, pointCount);
         weights.resize(1, pointCount);
 
-        for (int i=0; i<pointCount; ++i) {
-            int y = i / sqrtVal, x = i % sqrtVal;
-            Point2f sample;
-
-            switch (pointType) {
-                case Independent:
-                    sample = Point2f(rng.nextFloat(), rng.nextFloat());
-                    break;
-
-                case Grid:
-                    sample = Point2f((x + 0.5f) * invSqrtVal, (y + 0.5f) * invSqrtVal);
-                    break;
-
-                case Stratified:
-                    sample = Point2f((x + rng.nextFloat()) * invSqrtVal,
-                                     (y + rng.nextFloat()) * invSqrtVal);
-                    break;
+        /* Points are generated in parallel, in chunks of a fixed size with
+           separate random number streams (independent of the thread count) */
+        const int chunkSize = 16384;
+        int chunkCount = (pointCount + chunkSize - 1) / chunkSize;
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, chunkCount),
+            [&](const tbb::blocked_range<int> &range) {
+                for (int chunk = range.begin(); chunk != range.end(); ++chunk) {
+                    pcg32 rng(PCG32_DEFAULT_STATE, (uint64_t) chunk);
+                    int end = std::min(pointCount, (chunk + 1) * chunkSize);
+
+                    for (int i=chunk * chunkSize; i<end; ++i) {
+                        int y = i / sqrtVal, x = i % sqrtVal;
+                        Point2f sample;
+
+                        switch (pointType) {
+                            case Independent:
+                                sample = Point2f(rng.nextFloat(), rng.nextFloat());
+                                break;
+
+                            case Grid:
+                                sample = Point2f((x + 0.5f) * invSqrtVal, (y + 0.5f) * invSqrtVal);
+                                break;
+
+                            case Stratified:
+                                sample = Point2f((x + rng.nextFloat()) * invSqrtVal,
+                                                 (y + rng.nextFloat()) * invSqrtVal);
+                                break;
+                        }
+
+                        auto result = warpPoint(warpType, sample, parameterValue);
+                        positions.col(i) = result.first;
+                        weights(0, i) = result.second;
+                    }
+                }
             }
-
-            auto result = warpPoint(warpType, sample, parameterValue);
-            positions.col(i) = result.first;
-            weights(0, i) = result.second;
-        }
+        );
     }
 
     void refresh() {
@@ -491,7 +506,7 @@ public:
             scale *= 4*M_PI;
 
         double *ptr = expFrequencies.get();
-        for (int y=0; y<yres; ++y) {
+        tbb::parallel_for(0, yres, [&](int y) {
             double yStart =  y    / (double) yres;
             double yEnd   = (y+1) / (double) yres;
             for (int x=0; x<xres; ++x) {
@@ -502,7 +517,7 @@ public:
                 if (ptr[y * xres + x] < 0)
                     throw NoriException("The Pdf() function returned negative values!");
             }
-        }
+        });
 
         /* Write the test input data to disk for debugging */
         hypothesis::chi2_dump(yres, xres, obsFrequencies.get(), expFrequencies.get(), "chitest.m");
@@ -6,7 +6,7 @@
 #include <nori/bsdf.h>
 #include <nori/emitter.h>
 #include <fstream>
-#include <Eigen/src/Geometry/Transform.h>
+#include <Eigen/Geometry>
 
 
 
@@ -27,8 +27,11 @@ public:
 
 		Intersection its; //fisrt surface interaction
 
-		if (!scene->rayIntersect(ray, its))
-			return Color3f(0.0f);
+		if (!scene->rayIntersect(ray, its)) {
+			/* Rays that escape the scene receive the radiance of the environment */
+			const Emitter *environment = scene->getEnvironment();
+			return environment ? environment->evalEnvironment(ray.d) : Color3f(0.0f);
+		}
 
 
 